@@ -0,0 +1,190 @@
+#ifndef BACKTESTENGINE_H
+#define BACKTESTENGINE_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "util.h"
+#include "multiObjective.h"
+
+// Scores buy/sell prediction series against one price series.
+//
+// Every (series, threshold) pair is one strategy. The position of each
+// strategy follows the same rules as the original trading fitness: buy when
+// flat and only the buy signal fires, sell when holding and only the sell
+// signal fires. The cumulative price is the prefix sum of the per-tick deltas
+// in the data cube, so the P&L of a strategy is -sum(dPosition * cumPrice).
+//
+// Strategies are laid out contiguously per timestep, so the inner loop has no
+// branches and vectorizes across strategies.
+class BacktestEngine
+{
+public:
+
+	struct Settings
+	{
+		std::vector<double> thresholds = {0.5};
+
+		// charged on every buy and every sell, in normalized price units
+		double transactionCost = 0.0;
+	};
+
+	// one row per threshold, one column per prediction series
+	struct Results
+	{
+		arma::mat pnl;
+		arma::mat numTrades;
+		arma::mat maxDrawdown;
+	};
+
+	Settings& GetSettings() { return settings; }
+	const Settings& GetSettings() const { return settings; }
+	long long GetNumTicks() const { return cumPrices.n_elem; }
+
+	// in_priceDeltas is in the GetInputData() layout: (1, ticks, 1)
+	explicit BacktestEngine(const arma::cube& in_priceDeltas)
+	:settings()
+	,cumPrices(in_priceDeltas.n_cols)
+	{
+		double runningCost = 0.0;
+
+		for (arma::uword i = 0; i < in_priceDeltas.n_cols; i++)
+		{
+			runningCost += in_priceDeltas(0, i, 0);
+			cumPrices[i] = runningCost;
+		}
+	}
+
+	// in_predictions is (2, ticks, numSeries), row 0 is buy and row 1 is sell,
+	// which is what RNN::Predict() returns for a single series
+	Results Run(const arma::cube& in_predictions) const
+	{
+		const arma::uword numThresholds = settings.thresholds.size();
+		const arma::uword numSeries = in_predictions.n_slices;
+		const arma::uword numStrategies = numThresholds * numSeries;
+		const arma::uword numTicks = std::min<arma::uword>(
+				in_predictions.n_cols, cumPrices.n_elem);
+
+		if (in_predictions.n_rows < 2)
+		{
+			ReportFatalError("error, predictions need buy and sell rows");
+		}
+
+		// Score() and ScoreObjectives() read the first strategy
+		if ((numThresholds == 0) || (numSeries == 0))
+		{
+			ReportFatalError("error, backtest needs a threshold and a prediction series");
+		}
+
+		// buyOnly/sellOnly are 1.0 when only that signal is above the threshold
+		arma::mat buyOnly(numStrategies, numTicks);
+		arma::mat sellOnly(numStrategies, numTicks);
+
+		// filled one column per tick, the matrices are column major
+		for (arma::uword t = 0; t < numTicks; t++)
+		{
+			double* buyCol = buyOnly.colptr(t);
+			double* sellCol = sellOnly.colptr(t);
+
+			for (arma::uword s = 0; s < numSeries; s++)
+			{
+				const double buySignal = in_predictions(0, t, s);
+				const double sellSignal = in_predictions(1, t, s);
+
+				for (arma::uword k = 0; k < numThresholds; k++)
+				{
+					const double threshold = settings.thresholds[k];
+					const double buy = buySignal > threshold;
+					const double sell = sellSignal > threshold;
+
+					buyCol[s * numThresholds + k] = buy * (1.0 - sell);
+					sellCol[s * numThresholds + k] = sell * (1.0 - buy);
+				}
+			}
+		}
+
+		std::vector<double> position(numStrategies, 0.0);
+		std::vector<double> cash(numStrategies, 0.0);
+		std::vector<double> trades(numStrategies, 0.0);
+		std::vector<double> peak(numStrategies, 0.0);
+		std::vector<double> drawdown(numStrategies, 0.0);
+
+		const double cost = settings.transactionCost;
+
+		for (arma::uword t = 0; t < numTicks; t++)
+		{
+			const double price = cumPrices[t];
+			const double* buyCol = buyOnly.colptr(t);
+			const double* sellCol = sellOnly.colptr(t);
+
+			for (arma::uword j = 0; j < numStrategies; j++)
+			{
+				const double held = position[j];
+
+				// flat -> buyOnly, holding -> !sellOnly
+				const double next = held + buyCol[j] * (1.0 - held) - sellCol[j] * held;
+				const double change = next - held;
+
+				cash[j] -= change * price + cost * change * change;
+				trades[j] += change * change;
+
+				const double equity = cash[j] + next * price;
+				peak[j] = std::max(peak[j], equity);
+				drawdown[j] = std::max(drawdown[j], peak[j] - equity);
+
+				position[j] = next;
+			}
+		}
+
+		Results results;
+		results.pnl = arma::mat(cash.data(), numThresholds, numSeries);
+		results.numTrades = arma::mat(trades.data(), numThresholds, numSeries);
+		results.maxDrawdown = arma::mat(drawdown.data(), numThresholds, numSeries);
+
+		return results;
+	}
+
+	// P&L of the first threshold on the first series, the original fitness
+	double Score(const arma::cube& in_prediction) const
+	{
+		return Run(in_prediction).pnl(0, 0);
+	}
+
+	// (P&L, -max drawdown, -number of trades) of the first threshold on the
+	// first series, for multi-objective training
+	Objectives<3> ScoreObjectives(const arma::cube& in_prediction) const
+	{
+		Results results = Run(in_prediction);
+		return {results.pnl(0, 0), -results.maxDrawdown(0, 0), -results.numTrades(0, 0)};
+	}
+
+	// differentiable stand-in for Score(): the position is a sigmoid of
+	// (buy - sell) instead of the thresholded state machine, so small weight
+	// changes move the result. Used for gradient refinement only.
+	double SmoothScore(const arma::cube& in_prediction, double in_sharpness = 10.0) const
+	{
+		const arma::uword numTicks = std::min<arma::uword>(
+				in_prediction.n_cols, cumPrices.n_elem);
+
+		double score = 0.0;
+		double held = 0.0;
+
+		for (arma::uword t = 0; t < numTicks; t++)
+		{
+			const double signal = in_prediction(0, t, 0) - in_prediction(1, t, 0);
+			const double next = 1.0 / (1.0 + std::exp(-in_sharpness * signal));
+
+			score -= (next - held) * cumPrices[t];
+			held = next;
+		}
+
+		return score;
+	}
+
+private:
+	Settings settings;
+	arma::vec cumPrices;
+};
+
+#endif
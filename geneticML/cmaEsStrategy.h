@@ -0,0 +1,164 @@
+#ifndef CMAESSTRATEGY_H
+#define CMAESSTRATEGY_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "searchStrategy.h"
+
+// (mu/mu_w, lambda) CMA-ES with rank-one and rank-mu covariance updates and
+// cumulative step size adaptation, following Hansen's "The CMA Evolution
+// Strategy: A Tutorial". All updates are Armadillo matrix expressions, the
+// eigen decomposition of C is refreshed every few generations.
+//
+// Candidates are clamped to [minWeight, maxWeight] and the update uses the
+// clamped steps, which keeps the mean inside the box.
+class CmaEsStrategy : public SearchStrategy
+{
+public:
+	// in_sigma is the initial step size relative to the weight range
+	CmaEsStrategy(size_t in_dimension, size_t in_lambda,
+	              double in_minWeight, double in_maxWeight, double in_sigma)
+	:dimension(in_dimension)
+	,lambda(std::max<size_t>(in_lambda, 4))
+	,mu(lambda / 2)
+	,minWeight(in_minWeight)
+	,maxWeight(in_maxWeight)
+	,sigma(in_sigma * (in_maxWeight - in_minWeight))
+	,generation(0)
+	,eigenGeneration(0)
+	{
+		const double n = dimension;
+
+		weights = arma::vec(mu);
+		for (size_t i = 0; i < mu; i++)
+		{
+			weights[i] = std::log(mu + 0.5) - std::log(i + 1.0);
+		}
+		weights /= arma::accu(weights);
+		muEff = 1.0 / arma::accu(arma::square(weights));
+
+		cc = (4.0 + muEff / n) / (n + 4.0 + 2.0 * muEff / n);
+		cs = (muEff + 2.0) / (n + muEff + 5.0);
+		c1 = 2.0 / ((n + 1.3) * (n + 1.3) + muEff);
+		cmu = std::min(1.0 - c1,
+			2.0 * (muEff - 2.0 + 1.0 / muEff) / ((n + 2.0) * (n + 2.0) + muEff));
+		damps = 1.0 + 2.0 * std::max(0.0, std::sqrt((muEff - 1.0) / (n + 1.0)) - 1.0) + cs;
+		chiN = std::sqrt(n) * (1.0 - 1.0 / (4.0 * n) + 1.0 / (21.0 * n * n));
+
+		mean = arma::vec(dimension);
+		FillUniform(mean, minWeight, maxWeight);
+
+		pc = arma::zeros<arma::vec>(dimension);
+		ps = arma::zeros<arma::vec>(dimension);
+		B = arma::eye<arma::mat>(dimension, dimension);
+		D = arma::ones<arma::vec>(dimension);
+		C = arma::eye<arma::mat>(dimension, dimension);
+		invSqrtC = arma::eye<arma::mat>(dimension, dimension);
+	}
+
+	const char* Name() const override { return "CMA-ES"; }
+
+	// principal axes of the sampling distribution and their lengths, as of
+	// the last eigen decomposition
+	const arma::mat& GetAxes() const { return B; }
+	const arma::vec& GetAxisLengths() const { return D; }
+
+	void Ask(arma::mat& out_candidates) override
+	{
+		arma::mat z(dimension, lambda);
+		FillNormal(z);
+
+		out_candidates = B * (arma::diagmat(D) * z);
+		out_candidates *= sigma;
+		out_candidates.each_col() += mean;
+		out_candidates.clamp(minWeight, maxWeight);
+	}
+
+	void Tell(const arma::mat& in_candidates, const arma::vec& in_fitness) override
+	{
+		const double n = dimension;
+		generation++;
+
+		// best first
+		const arma::uvec order = arma::sort_index(in_fitness, "descend");
+
+		arma::mat steps(dimension, mu);
+		for (size_t i = 0; i < mu; i++)
+		{
+			steps.col(i) = (in_candidates.col(order[i]) - mean) / sigma;
+		}
+
+		const arma::vec meanStep = steps * weights;
+		mean += sigma * meanStep;
+
+		ps = (1.0 - cs) * ps + std::sqrt(cs * (2.0 - cs) * muEff) * (invSqrtC * meanStep);
+
+		const double psNorm = arma::norm(ps);
+		const bool hsig = psNorm / std::sqrt(1.0 - std::pow(1.0 - cs, 2.0 * generation)) / chiN
+				< 1.4 + 2.0 / (n + 1.0);
+
+		pc = (1.0 - cc) * pc + (hsig ? std::sqrt(cc * (2.0 - cc) * muEff) : 0.0) * meanStep;
+
+		const double hsigCorrection = hsig ? 0.0 : cc * (2.0 - cc);
+		C = (1.0 - c1 - cmu + c1 * hsigCorrection) * C
+			+ c1 * (pc * pc.t())
+			+ cmu * (steps * arma::diagmat(weights) * steps.t());
+
+		sigma *= std::exp((cs / damps) * (psNorm / chiN - 1.0));
+
+		// refreshing B and D every generation costs O(n^3), the tutorial
+		// spaces it out so the amortized cost stays O(n^2). Its threshold
+		// counts evaluations, lambda of them per generation.
+		if ((generation - eigenGeneration) * (double) lambda > lambda / (c1 + cmu) / n / 10.0)
+		{
+			eigenGeneration = generation;
+			UpdateEigen();
+		}
+	}
+
+private:
+	size_t dimension;
+	size_t lambda;
+	size_t mu;
+	double minWeight;
+	double maxWeight;
+
+	double sigma;
+	double muEff;
+	double cc;
+	double cs;
+	double c1;
+	double cmu;
+	double damps;
+	double chiN;
+
+	long long generation;
+	long long eigenGeneration;
+
+	arma::vec weights;
+	arma::vec mean;
+	arma::vec pc;
+	arma::vec ps;
+	arma::mat B;
+	arma::vec D;
+	arma::mat C;
+	arma::mat invSqrtC;
+
+	void UpdateEigen()
+	{
+		C = arma::symmatu(C);
+
+		arma::vec eigenValues;
+		if (!arma::eig_sym(eigenValues, B, C))
+		{
+			ReportFatalError("error, CMA-ES covariance decomposition failed");
+		}
+
+		D = arma::sqrt(arma::clamp(eigenValues, 1e-20, std::numeric_limits<double>::max()));
+		invSqrtC = B * arma::diagmat(1.0 / D) * B.t();
+	}
+};
+
+#endif
@@ -0,0 +1,230 @@
+#ifndef DATASETREGISTRY_H
+#define DATASETREGISTRY_H
+
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#include "util.h"
+#include "genome.h"
+#include "ctpl_stl.h"
+
+// Loads market data files once and hands out shared read-only cubes.
+//
+// Files are parsed on a pool of loader threads. A file asked for twice,
+// under any spelling of its path, is loaded once, and files whose parsed
+// data is identical share one cube. With a cache directory the parsed
+// cubes are also stored as arma_binary, keyed by path, size and
+// modification time, so later runs skip the JSON parsing.
+class DatasetRegistry
+{
+using ThreadPool = ctpl::thread_pool;
+
+public:
+	using Handle = std::shared_ptr<const arma::cube>;
+
+	struct Settings
+	{
+		// empty keeps the cache in memory only
+		std::string cacheDirectory;
+		int numLoaders = std::thread::hardware_concurrency();
+	};
+
+	explicit DatasetRegistry(const Settings& in_settings)
+	:settings(in_settings)
+	,numParsed(0)
+	,numDiskCacheHits(0)
+	,numDuplicates(0)
+	,loaders(std::max(in_settings.numLoaders, 1))
+	{
+		if (!settings.cacheDirectory.empty())
+		{
+			std::error_code error;
+			std::filesystem::create_directories(settings.cacheDirectory, error);
+		}
+	}
+
+	// forbid copying of any kind
+	DatasetRegistry(const DatasetRegistry&) = delete;
+	DatasetRegistry& operator=(const DatasetRegistry&) = delete;
+
+	// starts loading in the background, returns at once
+	void Prefetch(const std::vector<std::string>& in_fileNames)
+	{
+		for (auto& it : in_fileNames)
+		{
+			Request(it);
+		}
+	}
+
+	// waits for the file, nullptr with the reason in out_error when it
+	// could not be loaded
+	Handle Get(const std::string& in_fileName, ErrMsg* out_error = nullptr)
+	{
+		const Loaded& loaded = Request(in_fileName).get();
+
+		if (auto* error = std::get_if<ErrMsg>(&loaded); error != nullptr)
+		{
+			if (out_error)
+			{
+				*out_error = *error;
+			}
+			return nullptr;
+		}
+
+		return std::get<Handle>(loaded);
+	}
+
+	Handle GetExitOnError(const std::string& in_fileName)
+	{
+		ErrMsg error;
+		Handle handle = Get(in_fileName, &error);
+
+		if (!handle)
+		{
+			ReportFatalError(error);
+		}
+		return handle;
+	}
+
+	long long GetNumParsed() const { return numParsed; }
+	long long GetNumDiskCacheHits() const { return numDiskCacheHits; }
+	long long GetNumDuplicates() const { return numDuplicates; }
+
+private:
+	using Loaded = std::variant<Handle, ErrMsg>;
+
+	std::shared_future<Loaded> Request(const std::string& in_fileName)
+	{
+		std::error_code error;
+		std::filesystem::path path = std::filesystem::weakly_canonical(in_fileName, error);
+		if (error)
+		{
+			path = in_fileName;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto it = entries.find(path.string());
+		if (it != entries.end())
+		{
+			return it->second;
+		}
+
+		std::shared_future<Loaded> loaded = loaders.push(
+			[this, path] (int) { return Load(path); } ).share();
+
+		entries.emplace(path.string(), loaded);
+		return loaded;
+	}
+
+	Loaded Load(const std::filesystem::path& in_path)
+	{
+		arma::cube data;
+		const std::string cacheFile = CacheFileName(in_path);
+
+		if (!cacheFile.empty() && data.load(cacheFile, arma::arma_binary))
+		{
+			numDiskCacheHits++;
+		}
+		else
+		{
+			CubeWError parsed = GetInputData(in_path.string());
+
+			if (auto* error = std::get_if<ErrMsg>(&parsed); error != nullptr)
+			{
+				return *error;
+			}
+
+			data = std::move(std::get<arma::cube>(parsed));
+			numParsed++;
+
+			if (!cacheFile.empty() && !data.save(cacheFile, arma::arma_binary))
+			{
+				Log( "could not write dataset cache: ", cacheFile);
+			}
+		}
+
+		const arma::uword shape[] = {data.n_rows, data.n_cols, data.n_slices};
+		const uint64_t contentHash = HashBytes(
+			data.memptr(), data.n_elem * sizeof(double),
+			HashBytes(shape, sizeof(shape)) );
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// the hash only narrows it down, a hit has to match exactly
+		auto range = contents.equal_range(contentHash);
+		for (auto it = range.first; it != range.second; it++)
+		{
+			if (IsSameData(*it->second, data))
+			{
+				numDuplicates++;
+				return it->second;
+			}
+		}
+
+		Handle handle = std::make_shared<const arma::cube>(std::move(data));
+		contents.emplace(contentHash, handle);
+		return handle;
+	}
+
+	static bool IsSameData(const arma::cube& in_a, const arma::cube& in_b)
+	{
+		return (in_a.n_rows == in_b.n_rows) &&
+		       (in_a.n_cols == in_b.n_cols) &&
+		       (in_a.n_slices == in_b.n_slices) &&
+		       (std::memcmp(in_a.memptr(), in_b.memptr(), in_a.n_elem * sizeof(double)) == 0);
+	}
+
+	// empty when there is no cache directory or the file can't be stat'ed
+	std::string CacheFileName(const std::filesystem::path& in_path) const
+	{
+		if (settings.cacheDirectory.empty())
+		{
+			return "";
+		}
+
+		std::error_code sizeError;
+		std::error_code timeError;
+		const auto size = std::filesystem::file_size(in_path, sizeError);
+		const auto modified = std::filesystem::last_write_time(in_path, timeError);
+		if (sizeError || timeError)
+		{
+			return "";
+		}
+
+		const std::string pathName = in_path.string();
+		const auto modifiedTicks = modified.time_since_epoch().count();
+
+		uint64_t key = HashBytes(pathName.data(), pathName.size());
+		key = HashBytes(&size, sizeof(size), key);
+		key = HashBytes(&modifiedTicks, sizeof(modifiedTicks), key);
+
+		char buf[32];
+		snprintf(buf, 32, "%016llx.bin", (unsigned long long) key);
+		return (std::filesystem::path(settings.cacheDirectory) / buf).string();
+	}
+
+	Settings settings;
+
+	// guards entries and contents
+	std::mutex mutex;
+	std::unordered_map<std::string, std::shared_future<Loaded>> entries;
+	std::unordered_multimap<uint64_t, Handle> contents;
+
+	std::atomic<long long> numParsed;
+	std::atomic<long long> numDiskCacheHits;
+	std::atomic<long long> numDuplicates;
+
+	// last, so pending loads finish before the members they use go away
+	ThreadPool loaders;
+};
+
+#endif
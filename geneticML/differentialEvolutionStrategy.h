@@ -0,0 +1,99 @@
+#ifndef DIFFERENTIALEVOLUTIONSTRATEGY_H
+#define DIFFERENTIALEVOLUTIONSTRATEGY_H
+
+#include <algorithm>
+#include <limits>
+
+#include "searchStrategy.h"
+
+// DE/rand/1/bin. Every member of the population gets one trial vector per
+// generation: a = x_r1 + F * (x_r2 - x_r3), crossed over with the member at
+// rate CR (at least one weight always comes from a). The trial replaces the
+// member when it scores at least as well.
+class DifferentialEvolutionStrategy : public SearchStrategy
+{
+public:
+	DifferentialEvolutionStrategy(size_t in_dimension, size_t in_populationSize,
+	                              double in_minWeight, double in_maxWeight,
+	                              double in_scale, double in_crossover)
+	:dimension(in_dimension)
+	,populationSize(std::max<size_t>(in_populationSize, 4))
+	,minWeight(in_minWeight)
+	,maxWeight(in_maxWeight)
+	,scale(in_scale)
+	,crossover(in_crossover)
+	,population(in_dimension, populationSize)
+	,fitness(populationSize)
+	,initialized(false)
+	{
+		FillUniform(population, minWeight, maxWeight);
+		fitness.fill(-std::numeric_limits<double>::infinity());
+	}
+
+	const char* Name() const override { return "DE/rand/1/bin"; }
+
+	void Ask(arma::mat& out_candidates) override
+	{
+		// the first generation scores the initial population itself
+		if (!initialized)
+		{
+			out_candidates = population;
+			return;
+		}
+
+		auto memberDist = UserRNG::GetRngFn(0, (int) populationSize - 1);
+		auto weightIndexDist = UserRNG::GetRngFn(0, (int) dimension - 1);
+
+		arma::mat crossoverMask(dimension, populationSize);
+		FillUniform(crossoverMask, 0.0, 1.0);
+
+		out_candidates.set_size(dimension, populationSize);
+
+		for (size_t i = 0; i < populationSize; i++)
+		{
+			size_t r1, r2, r3;
+			do { r1 = memberDist(); } while (r1 == i);
+			do { r2 = memberDist(); } while (r2 == i || r2 == r1);
+			do { r3 = memberDist(); } while (r3 == i || r3 == r1 || r3 == r2);
+
+			const arma::vec mutant =
+				population.col(r1) + scale * (population.col(r2) - population.col(r3));
+
+			// binomial crossover as a blend with a 0/1 mask
+			arma::vec take = arma::conv_to<arma::vec>::from(crossoverMask.col(i) < crossover);
+			take[weightIndexDist()] = 1.0;
+
+			out_candidates.col(i) = take % mutant + (1.0 - take) % population.col(i);
+		}
+
+		out_candidates.clamp(minWeight, maxWeight);
+	}
+
+	void Tell(const arma::mat& in_candidates, const arma::vec& in_fitness) override
+	{
+		for (size_t i = 0; i < populationSize; i++)
+		{
+			if (!initialized || (in_fitness[i] >= fitness[i]))
+			{
+				population.col(i) = in_candidates.col(i);
+				fitness[i] = in_fitness[i];
+			}
+		}
+
+		initialized = true;
+	}
+
+private:
+	size_t dimension;
+	size_t populationSize;
+	double minWeight;
+	double maxWeight;
+	double scale;
+	double crossover;
+
+	arma::mat population;
+	arma::vec fitness;
+	bool initialized;
+};
+
+#endif
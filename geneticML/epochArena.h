@@ -0,0 +1,129 @@
+#ifndef EPOCHARENA_H
+#define EPOCHARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+
+// Passed to a fitness function that takes it as a second argument, see
+// GeneticAlgoTrainer. Containers built on memory are freed in bulk at the
+// end of the epoch, so they never touch the global heap in the hot loop.
+struct FitnessContext
+{
+	std::pmr::memory_resource* memory;
+	int worker;
+};
+
+// forwards to in_upstream and counts what goes through
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+	explicit CountingResource(std::pmr::memory_resource* in_upstream)
+	:upstream(in_upstream)
+	,numAllocations(0)
+	,numBytes(0)
+	{
+	}
+
+	long long GetNumAllocations() const { return numAllocations; }
+	long long GetNumBytes() const { return numBytes; }
+
+	void ResetCounts()
+	{
+		numAllocations = 0;
+		numBytes = 0;
+	}
+
+private:
+	void* do_allocate(size_t in_bytes, size_t in_alignment) override
+	{
+		numAllocations++;
+		numBytes += in_bytes;
+		return upstream->allocate(in_bytes, in_alignment);
+	}
+
+	void do_deallocate(void* in_ptr, size_t in_bytes, size_t in_alignment) override
+	{
+		upstream->deallocate(in_ptr, in_bytes, in_alignment);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& in_other) const noexcept override
+	{
+		return this == &in_other;
+	}
+
+	std::pmr::memory_resource* upstream;
+	long long numAllocations;
+	long long numBytes;
+};
+
+// Memory for one worker thread's temporaries during one epoch. A pool
+// recycles freed blocks on top of a monotonic buffer that starts in a block
+// reserved up front and only falls back to the heap when that runs out.
+// Reset() at the epoch boundary drops everything at once.
+//
+// Not thread safe, each worker owns one.
+class EpochArena
+{
+public:
+	struct Stats
+	{
+		long long numAllocations = 0;
+		long long numBytes = 0;
+
+		// allocations the reserved block could not serve
+		long long numHeapAllocations = 0;
+
+		Stats& operator+=(const Stats& in_other)
+		{
+			numAllocations += in_other.numAllocations;
+			numBytes += in_other.numBytes;
+			numHeapAllocations += in_other.numHeapAllocations;
+			return *this;
+		}
+	};
+
+	// the block is left uninitialized, so pages an epoch never reaches are
+	// not committed. Matters with many trainers sharing one pool.
+	explicit EpochArena(size_t in_capacity)
+	:buffer(new std::byte[std::max<size_t>(in_capacity, 1)])
+	,heap(std::pmr::new_delete_resource())
+	,monotonic(buffer.get(), std::max<size_t>(in_capacity, 1), &heap)
+	,pool(&monotonic)
+	,counter(&pool)
+	{
+	}
+
+	EpochArena(const EpochArena&) = delete;
+	EpochArena& operator=(const EpochArena&) = delete;
+
+	std::pmr::memory_resource* GetResource() { return &counter; }
+
+	Stats GetStats() const
+	{
+		Stats stats;
+		stats.numAllocations = counter.GetNumAllocations();
+		stats.numBytes = counter.GetNumBytes();
+		stats.numHeapAllocations = heap.GetNumAllocations();
+		return stats;
+	}
+
+	// everything allocated since the last reset becomes invalid
+	void Reset()
+	{
+		pool.release();
+		monotonic.release();
+		counter.ResetCounts();
+		heap.ResetCounts();
+	}
+
+private:
+	std::unique_ptr<std::byte[]> buffer;
+	CountingResource heap;
+	std::pmr::monotonic_buffer_resource monotonic;
+	std::pmr::unsynchronized_pool_resource pool;
+	CountingResource counter;
+};
+
+#endif
@@ -3,8 +3,41 @@
 
 #include "organism.h"
 #include "userRNG.h"
+#include "multiObjective.h"
+#include "genomeIndex.h"
+#include "memeticRefiner.h"
+#include "cmaEsStrategy.h"
+#include "differentialEvolutionStrategy.h"
+#include "surrogateModel.h"
+#include "remoteEvaluator.h"
+#include "epochArena.h"
 #include "ctpl_stl.h"
 
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+
+// result of a fitness function taking (BaseType&) or
+// (BaseType&, const FitnessContext&)
+template <class FitnessFn, class BaseType, class = void>
+struct FitnessResult
+{
+	using type = typename std::result_of<FitnessFn(BaseType&)>::type;
+};
+
+template <class FitnessFn, class BaseType>
+struct FitnessResult<FitnessFn, BaseType,
+	std::void_t<typename std::result_of<FitnessFn(BaseType&, const FitnessContext&)>::type>>
+{
+	using type = typename std::result_of<FitnessFn(BaseType&, const FitnessContext&)>::type;
+};
+
 template <class CreateFn, class FitnessFn>
 class GeneticAlgoTrainer
 {
@@ -12,11 +45,24 @@ class GeneticAlgoTrainer
 using BaseType =
     typename std::remove_pointer<
         typename std::result_of<CreateFn()>::type>::type;
+
+// double, or Objectives<M> for multi-objective (NSGA-II style) selection
+using FitnessType =
+    typename std::decay<
+        typename FitnessResult<FitnessFn, BaseType>::type>::type;
     
 using ThreadPool = ctpl::thread_pool;
 
+using ParamsType =
+    typename std::decay<
+        decltype(std::declval<BaseType&>().Parameters())>::type;
+
+using Clock = std::chrono::steady_clock;
+
 public:
 
+	enum class SearchType {Genetic=0, CmaEs, DifferentialEvolution};
+
 	struct Settings
 	{
         float minWeight = -1.0;
@@ -33,11 +79,193 @@ public:
         
         float minMutationPercent = 0.0;
         float maxMutationPercent = 0.25;
-		
+
+		// re-evolve children that duplicate a survivor, falling back to a
+		// random genome after maxDuplicateRetries
+		bool rejectDuplicates = false;
+		int maxDuplicateRetries = 3;
+
+		// SimHash hamming distance under which genomes count as duplicates
+		// and share a niche, 0 means exact copies only. Up to 63, larger
+		// distances make the index slower, see GenomeIndex.
+		int nearDuplicateDistance = 0;
+
+		// divide fitness by the size of the organism's niche
+		bool useFitnessSharing = false;
+
+		// every child draws from an engine seeded by (seed, epoch, slot), so
+		// runs repeat exactly regardless of thread count and scheduling
+		bool deterministic = false;
+		unsigned long long seed = 0;
+
+		// stopping criteria checked between epochs, 0 disables each one
+		double maxSeconds = 0.0;
+		long long maxEvaluations = 0;
+
+		// stop when the best fitness has not improved by more than
+		// plateauTolerance for plateauEpochs epochs
+		int plateauEpochs = 0;
+		double plateauTolerance = 1e-9;
+
+		// every memeticInterval epochs the memeticEliteCount best organisms
+		// get memeticSteps of RMSProp on the refinement function, see
+		// SetRefinementFn(). 0 disables it. Needs double weights.
+		int memeticInterval = 0;
+		int memeticEliteCount = 10;
+		int memeticSteps = 10;
+		double memeticStepSize = 0.01;
+		double memeticPerturbation = 0.01;
+
+		// write improved weights back into the genome (Lamarckian), or only
+		// credit the genome with the refined fitness (Baldwinian)
+		bool memeticLamarckian = true;
+
+		// Genetic is the truncation/crossover search, CmaEs and
+		// DifferentialEvolution drive a SearchStrategy over the weights with
+		// numPopulation candidates per epoch. Those need double weights.
+		SearchType searchType = SearchType::Genetic;
+		double cmaSigma = 0.3;
+		double deScale = 0.5;
+		double deCrossover = 0.9;
+
+		// evolve surrogateCandidates children per slot and only evaluate the
+		// one the surrogate model ranks best, 1 disables it. The model is a
+		// random feature ridge regression refit every epoch on the last
+		// surrogateHistory evaluations, screening starts once it has
+		// surrogateMinSamples of them. Needs a single fitness.
+		int surrogateCandidates = 1;
+		int surrogateFeatures = 256;
+		int surrogateHistory = 4096;
+		int surrogateMinSamples = 200;
+		double surrogateRidge = 1e-3;
+
+		// kernel bandwidth relative to the typical distance between two
+		// random genomes
+		double surrogateBandwidth = 0.5;
+
+		// memory reserved per worker for the epoch's temporaries, see
+		// EpochArena. Allocations past it still succeed from the heap.
+		size_t arenaBytes = 1 << 20;
+
+		// keep the final population for the next Run() and start from it
+		// instead of from random organisms, see SetRescoreFn(). Genetic
+		// search only.
+		bool continuous = false;
+
+		// kept organisms rescored before the next run starts, 0 means all
+		// of the ones that would survive the first epoch. The others keep
+		// their fitness from the previous data.
+		int continuousEliteCount = 0;
+	};
+
+	// copy of the current best organism, published every epoch
+	struct EliteSnapshot
+	{
+		int epoch;
+		long long numEvaluations;
+		double elapsedSeconds;
+		FitnessType fitness;
+		ParamsType parameters;
 	};
 
-    BaseType* GetBestPerformer() { return nullptr; }//organisms.at(0)->GetBase().get(); }
+	using Diversity = GenomeIndex::Diversity;
+
+    // The results below are written by the running Run(). After RunAsync()
+    // they are only valid once Wait() returned, read progress with
+    // GetEliteSnapshot() meanwhile.
+
+    // best organism of the last Run(), nullptr before the first one
+    BaseType* GetBestPerformer() { return bestPerformer.get(); }
+
+    // writes the best organism's weights, see LstmInferenceEngine::LoadFromFile()
+    bool ExportBestPerformer(const std::string& in_fileName)
+    {
+        if (!bestPerformer)
+        {
+            return false;
+        }
+        return SaveGenome(bestPerformer->Parameters(), in_fileName);
+    }
+
 	Settings& GetSettings() { return settings; }
+	const Diversity& GetDiversity() const { return diversity; }
+	long long GetNumDuplicatesRejected() const { return numDuplicatesRejected; }
+
+	// hash of the final population's weights and fitness, equal for
+	// identical deterministic runs
+	uint64_t GetRunFingerprint() const { return runFingerprint; }
+
+	long long GetNumEvaluations() const { return numEvaluations; }
+	long long GetNumRefinementEvaluations() const { return numRefinementEvaluations; }
+
+	// candidates the surrogate screened out instead of evaluating them
+	long long GetNumEvaluationsSaved() const { return numEvaluationsSaved; }
+
+	// correlation between predicted and real fitness over the last epoch's
+	// screened children, NaN while the surrogate is not screening
+	double GetSurrogateCorrelation() const { return surrogateCorrelation; }
+
+	// smooth surrogate of the fitness followed by memetic refinement,
+	// the fitness function itself is used when none is set
+	void SetRefinementFn(std::function<double(BaseType&)> in_refinementFn)
+	{
+		refinementFn = std::move(in_refinementFn);
+	}
+
+	// updates the fitness of a kept organism for new data at the start of
+	// a continuous run, given its fitness on the previous data. Meant to
+	// score only the data that arrived since, without one the kept fitness
+	// is used as is.
+	void SetRescoreFn(std::function<FitnessType(BaseType&, const FitnessType&)> in_rescoreFn)
+	{
+		rescoreFn = std::move(in_rescoreFn);
+	}
+
+	// organisms kept for the next continuous run
+	size_t GetNumKept() const { return keptPopulation.size(); }
+
+	// the next continuous run starts from random organisms again
+	void ClearKeptPopulation() { keptPopulation.clear(); }
+
+	// allocations served by the worker arenas over the last run
+	const EpochArena::Stats& GetArenaStats() const { return arenaStats; }
+
+	// scores children in evaluator processes instead of in-process, the
+	// fitness function is then only used for memetic refinement. Needs a
+	// single fitness, the pool has to outlive the runs.
+	void SetRemoteEvaluator(RemoteEvaluatorPool* in_remoteEvaluator)
+	{
+		remoteEvaluator = in_remoteEvaluator;
+	}
+
+	// safe to call from any thread while Run() or RunAsync() is evolving,
+	// nullptr until the first epoch has been ranked
+	std::shared_ptr<const EliteSnapshot> GetEliteSnapshot() const
+	{
+		return std::atomic_load(&eliteSnapshot);
+	}
+
+	// runs Run() on a background thread, read progress with
+	// GetEliteSnapshot() and end it early with Stop(). The other getters
+	// and the settings are not synchronized, use them after Wait().
+	void RunAsync()
+	{
+		Wait();
+		stopRequested = false;
+		runThread = std::thread([this] () { RunSelected(); });
+	}
+
+	// asks the running Run() to stop at the next epoch boundary, the
+	// children of the current epoch are not evolved any further
+	void Stop() { stopRequested = true; }
+
+	void Wait()
+	{
+		if (runThread.joinable())
+		{
+			runThread.join();
+		}
+	}
     
     // forbid copying of any kind
 	GeneticAlgoTrainer() = delete;
@@ -47,34 +275,126 @@ public:
     GeneticAlgoTrainer operator()(const GeneticAlgoTrainer&& rhs) = delete;
 
     GeneticAlgoTrainer(const CreateFn& in_createFn, const FitnessFn& in_fitnessFn)
-    :fitnessFn(in_fitnessFn)
-    ,createFn(in_createFn)
-    ,settings()
-    ,workers(std::thread::hardware_concurrency())
+    :GeneticAlgoTrainer(in_createFn, in_fitnessFn,
+                        std::make_unique<ThreadPool>(std::thread::hardware_concurrency()))
+    {
+    }
+
+    // evolves on in_workers, shared with other trainers, see
+    // TrainingJobRunner. The pool has to outlive the trainer.
+    GeneticAlgoTrainer(const CreateFn& in_createFn, const FitnessFn& in_fitnessFn, ThreadPool& in_workers)
+    :GeneticAlgoTrainer(in_createFn, in_fitnessFn, std::unique_ptr<ThreadPool>(), &in_workers)
+    {
+    }
+
+    ~GeneticAlgoTrainer()
     {
+        Stop();
+        Wait();
     }
 
 	template<class M, class R>
 	void _Run(M& mutationFn, R& weightFn)
 	{
-using OrganismBase = Organism<BaseType, M, R>;
-using pOrganism = std::unique_ptr<OrganismBase>;
+using OrganismBase = Organism<BaseType, M, R, FitnessType>;
+
+// fixed size genomes are built in one block, see populationBlock below
+using pOrganism = typename std::conditional<OrganismBase::IsFixed,
+    std::unique_ptr<OrganismBase, DestroyOnly<OrganismBase>>,
+    std::unique_ptr<OrganismBase>>::type;
+
 using Organisms = std::vector<pOrganism>;
+using OrganismStorage =
+    typename std::aligned_storage<sizeof(OrganismBase), alignof(OrganismBase)>::type;
+
+		if (IsObjectiveVector<FitnessType>::value && (settings.surrogateCandidates > 1))
+		{
+			ReportFatalError("error, surrogate screening needs a single fitness");
+		}
 
+		if (IsObjectiveVector<FitnessType>::value && remoteEvaluator)
+		{
+			ReportFatalError("error, remote evaluation needs a single fitness");
+		}
+
+		runStart = Clock::now();
+		numEvaluations = 0;
+		numRefinementEvaluations = 0;
+		numEvaluationsSaved = 0;
+		surrogateCorrelation = std::numeric_limits<double>::quiet_NaN();
+		std::atomic_store(&eliteSnapshot, std::shared_ptr<const EliteSnapshot>());
+
+		// the whole population with its genomes side by side, declared first
+		// so it is freed after the organisms in it
+		std::vector<OrganismStorage> populationBlock;
 		Organisms organisms;
 
+		if constexpr (OrganismBase::IsFixed)
+		{
+			populationBlock.resize(settings.numPopulation);
+		}
+
         for (int i = 0; i < settings.numPopulation; i++)
         {
-            organisms.emplace_back(
-                std::make_unique<OrganismBase>(
-                    std::unique_ptr<BaseType>(createFn()),
-					mutationFn,
-					weightFn ) );
+            std::unique_ptr<BaseType> base(createFn());
+
+            if constexpr (OrganismBase::IsFixed)
+            {
+                organisms.emplace_back(
+                    new (&populationBlock.at(i)) OrganismBase(std::move(base), mutationFn, weightFn) );
+            }
+            else
+            {
+                organisms.emplace_back(
+                    std::make_unique<OrganismBase>(std::move(base), mutationFn, weightFn) );
+            }
         }
-        
+
 		int numOrganismsDel = settings.epochDeletePercent * settings.numPopulation;
 		int numOrganismsSave = settings.numPopulation - numOrganismsDel;
 
+		if (settings.continuous)
+		{
+			RestoreKeptPopulation(organisms, numOrganismsSave);
+		}
+        
+		GenomeIndex genomeIndex(
+			GenomeSize(organisms.at(0)->GetBase()->Parameters()),
+			(settings.minWeight + settings.maxWeight) / 2.0,
+			settings.nearDuplicateDistance );
+
+		for (auto& it : organisms)
+		{
+			const auto& params = it->GetBase()->Parameters();
+			genomeIndex.Insert(it.get(), genomeIndex.ComputeSignature(params), params);
+		}
+
+		std::vector<GenomeSignature> childSignatures(settings.numPopulation);
+
+		// workers only read the model, it is refit between epochs
+		std::unique_ptr<SurrogateModel> surrogate;
+		std::vector<arma::vec> childFeatures(settings.numPopulation);
+		std::vector<double> childPredictions(settings.numPopulation);
+
+		// pending remote scores, see SetRemoteEvaluator()
+		std::vector<std::future<double>> childRemoteFitness(settings.numPopulation);
+
+		if (settings.surrogateCandidates > 1)
+		{
+			const size_t genomeSize = GenomeSize(organisms.at(0)->GetBase()->Parameters());
+
+			// two uniform genomes are sqrt(n / 6) * range apart on average
+			const double bandwidth = settings.surrogateBandwidth
+				* (settings.maxWeight - settings.minWeight) * std::sqrt(genomeSize / 6.0);
+
+			surrogate = std::make_unique<SurrogateModel>(
+				genomeSize,
+				settings.surrogateFeatures,
+				bandwidth,
+				settings.surrogateHistory,
+				settings.surrogateRidge );
+		}
+
 		// higher fitness means better odds of being parents
 		std::vector<int> parentIndexDistributionWeights(numOrganismsSave);
 		std::for_each(
@@ -96,45 +416,204 @@ using Organisms = std::vector<pOrganism>;
 
 		auto fitnessCmpFn = [](const pOrganism& in_orgA, const pOrganism& in_orgB)
 		{
-			return in_orgA->GetFitness() > in_orgB->GetFitness();  
+			return in_orgA->GetSharedFitness() > in_orgB->GetSharedFitness();  
 		};
         
-        auto EvolveThenEval = [this] (
+        auto EvolveThenEval = [this, &genomeIndex, &surrogate, &childFeatures, &childPredictions, &childRemoteFitness] (
             OrganismBase* child,
             const OrganismBase* parentA,
             const OrganismBase* parentB,
             double mutationProbability,
-            typename OrganismBase::EvolveType evolveType )
+            typename OrganismBase::EvolveType evolveType,
+            GenomeSignature* signature,
+            int epoch,
+            int slot,
+            long long childID,
+            int worker )
         {
-            child->Evolve(parentA, parentB, evolveType);
-            child->SetFitness(fitnessFn(*child->GetBase()));
+            // out of time, leave the culled organism and its fitness as is
+            if (stopRequested || OutOfTime())
+            {
+                *signature = genomeIndex.ComputeSignature(child->GetBase()->Parameters());
+                return;
+            }
+
+            if (settings.deterministic)
+            {
+                UserRNG::Seed(settings.seed, epoch, slot);
+            }
+
+            const FitnessContext context{arenas.at(worker)->GetResource(), worker};
+
+            child->Evolve(parentA, parentB, evolveType, childID, context.memory);
+
+            // re-evolve from the same parents and keep the most promising
+            if (surrogate && surrogate->IsReady())
+            {
+                auto& params = child->GetBase()->Parameters();
+                ParamsType bestParams = params;
+                double bestPrediction = surrogate->Predict(params);
+
+                for (int candidate = 1; candidate < settings.surrogateCandidates; candidate++)
+                {
+                    child->Evolve(parentA, parentB, evolveType, childID, context.memory);
+
+                    const double prediction = surrogate->Predict(params);
+                    if (prediction > bestPrediction)
+                    {
+                        bestPrediction = prediction;
+                        bestParams = params;
+                    }
+                }
+
+                // assign in place, mlpack layers alias the parameter memory
+                params = bestParams;
+                childPredictions.at(slot) = bestPrediction;
+                numEvaluationsSaved += settings.surrogateCandidates - 1;
+            }
+
+            *signature = genomeIndex.ComputeSignature(child->GetBase()->Parameters());
+
+            // the index only holds the survivors here, so it is read only
+            for (int retry = 0;
+                 settings.rejectDuplicates &&
+                 retry <= settings.maxDuplicateRetries &&
+                 genomeIndex.IsDuplicate(*signature, child->GetBase()->Parameters());
+                 retry++ )
+            {
+                numDuplicatesRejected++;
+
+                child->Evolve(parentA, parentB, (retry < settings.maxDuplicateRetries)
+                        ? OrganismBase::EvolveType::ChildMutation
+                        : OrganismBase::EvolveType::Random,
+                        childID,
+                        context.memory );
+                *signature = genomeIndex.ComputeSignature(child->GetBase()->Parameters());
+            }
+
+            if (surrogate)
+            {
+                childFeatures.at(slot) = surrogate->Features(child->GetBase()->Parameters());
+            }
+
+            // the evaluators start on it while the other slots still evolve
+            if (remoteEvaluator)
+            {
+                childRemoteFitness.at(slot) = remoteEvaluator->Submit(child->GetBase()->Parameters());
+                return;
+            }
+
+            child->SetFitness(Evaluate(*child->GetBase(), context));
+            numEvaluations++;
         };
+
+        double bestPrimaryFitness = -std::numeric_limits<double>::infinity();
+        int numEpochsWithoutGain = 0;
         
+        // drawn on this thread in a fixed order, argument evaluation order
+        // is unspecified and workers pick slots in any order
+        struct ChildPlan
+        {
+            int parentA;
+            int parentB;
+            double mutationProbability;
+            typename OrganismBase::EvolveType evolveType;
+            long long childID;
+        };
+        std::vector<ChildPlan> childPlans(settings.numPopulation);
+
+        // one task per worker pulling slots, instead of a closure, task and
+        // future per child
+        std::atomic<int> nextChild(0);
         std::vector<std::future<void>> futures;
-        futures.reserve(numOrganismsDel);
+        futures.reserve(workers.size());
+
+        PrepareArenas();
 
 		for (int i = 0; i < settings.numEpoch; i++)
 		{
-			std::sort(organisms.begin(), organisms.end(), fitnessCmpFn);
+			SortOrganisms(organisms, fitnessCmpFn);
+
+			if ((settings.memeticInterval > 0) && (i > 0) && (i % settings.memeticInterval == 0))
+			{
+				RefineElites(organisms, genomeIndex, i);
+				SortOrganisms(organisms, fitnessCmpFn);
+			}
 
 			Log( "epoch: ", i);
 			Log( "rankings: ");
 
 			organisms.at(0)->DisplayFull();//organisms.at(1), organisms.at(2));
 
+			PublishElite(organisms.at(0)->GetBase()->Parameters(), organisms.at(0)->GetFitness(), i);
+
+			const double primaryFitness = PrimaryFitness(organisms.at(0)->GetFitness());
+			if (primaryFitness > bestPrimaryFitness + settings.plateauTolerance)
+			{
+				bestPrimaryFitness = primaryFitness;
+				numEpochsWithoutGain = 0;
+			}
+			else
+			{
+				numEpochsWithoutGain++;
+			}
+
+			diversity = genomeIndex.GetDiversity();
+			Log( "diversity: unique ", diversity.uniqueFraction,
+				 " niches ", diversity.nicheFraction,
+				 " duplicates rejected ", numDuplicatesRejected.load() );
+
+			if (const char* reason = StopReason(numEpochsWithoutGain, numOrganismsDel))
+			{
+				Log( "stopping early: ", reason);
+				break;
+			}
+
 			// don't evolve on the last epoch
 			if (i < settings.numEpoch - 1)
 			{
 				for (int j = numOrganismsSave; j < settings.numPopulation; j++)
 				{
-                    futures.emplace_back(
-                        workers.push( std::bind(
-                            EvolveThenEval,
-                            organisms.at(j).get(),
-                            organisms.at(parentIndexDist()).get(),
-                            organisms.at(parentIndexDist()).get(),
-                            mutProbDist(),
-                            (typename OrganismBase::EvolveType) childCreatorDist() )));
+					genomeIndex.Remove(organisms.at(j).get());
+				}
+
+				for (int j = numOrganismsSave; j < settings.numPopulation; j++)
+				{
+					childFeatures.at(j).reset();
+					childPredictions.at(j) = std::numeric_limits<double>::quiet_NaN();
+
+					ChildPlan& plan = childPlans.at(j);
+					plan.parentA = parentIndexDist();
+					plan.parentB = parentIndexDist();
+					plan.mutationProbability = mutProbDist();
+					plan.evolveType = (typename OrganismBase::EvolveType) childCreatorDist();
+					plan.childID = OrganismBase::NextID();
+				}
+
+				nextChild = numOrganismsSave;
+
+				for (int k = 0; k < workers.size(); k++)
+				{
+                    futures.emplace_back(workers.push(
+                        [&, i] (int in_worker)
+                    {
+                        for (int j = nextChild++; j < settings.numPopulation; j = nextChild++)
+                        {
+                            const ChildPlan& plan = childPlans.at(j);
+
+                            EvolveThenEval(
+                                organisms.at(j).get(),
+                                organisms.at(plan.parentA).get(),
+                                organisms.at(plan.parentB).get(),
+                                plan.mutationProbability,
+                                plan.evolveType,
+                                &childSignatures.at(j),
+                                i,
+                                j,
+                                plan.childID,
+                                in_worker );
+                        }
+                    } ));
 				}
                 
                 for (auto& it : futures)
@@ -142,7 +621,34 @@ using Organisms = std::vector<pOrganism>;
                     it.get();
                 }
                 futures.clear();
+
+				if (remoteEvaluator)
+				{
+					CollectRemoteFitness(organisms, childRemoteFitness, numOrganismsSave);
+				}
+
+				// siblings can still duplicate each other, they share a niche
+				for (int j = numOrganismsSave; j < settings.numPopulation; j++)
+				{
+					auto* child = organisms.at(j).get();
+					genomeIndex.Insert(child, childSignatures.at(j), child->GetBase()->Parameters());
+				}
+
+				if (settings.useFitnessSharing)
+				{
+					for (auto& it : organisms)
+					{
+						it->SetNicheCount(genomeIndex.NicheCount(it.get()));
+					}
+				}
+
+				if (surrogate)
+				{
+					UpdateSurrogate(*surrogate, organisms, childFeatures, childPredictions, numOrganismsSave);
+				}
 			}
+
+			ResetArenas();
 		}
 
         Log( "completed");
@@ -151,10 +657,69 @@ using Organisms = std::vector<pOrganism>;
 		{
 			it->DisplayFull();
 		}
+
+		runFingerprint = HashBytes(nullptr, 0);
+		for (auto& it : organisms)
+		{
+			AddToFingerprint(it->GetBase()->Parameters(), it->GetFitness());
+		}
+		LogFingerprint();
+
+		keptPopulation.clear();
+		if (settings.continuous)
+		{
+			// ranked, so the elite comes first next run
+			for (auto& it : organisms)
+			{
+				keptPopulation.push_back(KeptOrganism{it->GetBase()->Parameters(), it->GetFitness()});
+			}
+		}
+
+		bestPerformer = organisms.at(0)->ReleaseBase();
 	}
 
 	void Run()
 	{
+		stopRequested = false;
+		RunSelected();
+	}
+
+private:
+
+    // runs on in_ownedWorkers when given, otherwise on *in_workers
+    GeneticAlgoTrainer(const CreateFn& in_createFn, const FitnessFn& in_fitnessFn,
+                       std::unique_ptr<ThreadPool> in_ownedWorkers, ThreadPool* in_workers = nullptr)
+    :fitnessFn(in_fitnessFn)
+    ,createFn(in_createFn)
+    ,settings()
+    ,ownedWorkers(std::move(in_ownedWorkers))
+    ,workers(ownedWorkers ? *ownedWorkers : *in_workers)
+    ,diversity()
+    ,numDuplicatesRejected(0)
+    ,runFingerprint(0)
+    ,numEvaluations(0)
+    ,numRefinementEvaluations(0)
+    ,numEvaluationsSaved(0)
+    ,surrogateCorrelation(std::numeric_limits<double>::quiet_NaN())
+    ,remoteEvaluator(nullptr)
+    ,arenaStats()
+    ,stopRequested(false)
+    {
+    }
+    
+	void RunSelected()
+	{
+		if (settings.deterministic)
+		{
+			UserRNG::Seed(settings.seed);
+		}
+
+		if (settings.searchType != SearchType::Genetic)
+		{
+			_RunStrategy();
+			return;
+		}
+
 		auto mutationRNG = UserRNG::GetRngFn(
 			settings.minMutationPercent, settings.maxMutationPercent);
 
@@ -174,12 +739,500 @@ using Organisms = std::vector<pOrganism>;
 		}
 	};
 
-private:
-    
     const FitnessFn& fitnessFn;
     const CreateFn& createFn;
     Settings settings;
-    ThreadPool workers;
+    std::unique_ptr<ThreadPool> ownedWorkers;
+    ThreadPool& workers;
+    Diversity diversity;
+    std::atomic<long long> numDuplicatesRejected;
+    uint64_t runFingerprint;
+    std::unique_ptr<BaseType> bestPerformer;
+
+    std::atomic<long long> numEvaluations;
+    std::atomic<long long> numRefinementEvaluations;
+    std::function<double(BaseType&)> refinementFn;
+    std::function<FitnessType(BaseType&, const FitnessType&)> rescoreFn;
+
+    struct KeptOrganism
+    {
+        ParamsType parameters;
+        FitnessType fitness;
+    };
+    std::vector<KeptOrganism> keptPopulation;
+    std::atomic<long long> numEvaluationsSaved;
+    double surrogateCorrelation;
+    RemoteEvaluatorPool* remoteEvaluator;
+
+    // one per worker thread, indexed by the id the pool passes to tasks
+    std::vector<std::unique_ptr<EpochArena>> arenas;
+    EpochArena::Stats arenaStats;
+    std::atomic<bool> stopRequested;
+    Clock::time_point runStart;
+    std::shared_ptr<const EliteSnapshot> eliteSnapshot;
+    std::thread runThread;
+
+	double ElapsedSeconds() const
+	{
+		return std::chrono::duration<double>(Clock::now() - runStart).count();
+	}
+
+	bool OutOfTime() const
+	{
+		return (settings.maxSeconds > 0.0) && (ElapsedSeconds() > settings.maxSeconds);
+	}
+
+	// nullptr to keep going
+	const char* StopReason(int in_numEpochsWithoutGain, int in_numChildren) const
+	{
+		if (stopRequested)
+		{
+			return "stop requested";
+		}
+		if (OutOfTime())
+		{
+			return "time budget reached";
+		}
+		if ((settings.maxEvaluations > 0) &&
+		    (numEvaluations + in_numChildren > settings.maxEvaluations) )
+		{
+			return "evaluation budget reached";
+		}
+		if ((settings.plateauEpochs > 0) &&
+		    (in_numEpochsWithoutGain >= settings.plateauEpochs) )
+		{
+			return "fitness plateau";
+		}
+		return nullptr;
+	}
+
+	// refines the best organisms on the worker pool, keeping a refinement
+	// only when the real fitness improves
+	template<class Organisms>
+	void RefineElites(Organisms& io_organisms, GenomeIndex& io_genomeIndex, int in_epoch)
+	{
+		if constexpr (!std::is_same<ParamsType, arma::mat>::value ||
+		              IsObjectiveVector<FitnessType>::value )
+		{
+			ReportFatalError("error, memetic refinement needs double weights and a single fitness");
+		}
+		else
+		{
+			MemeticRefiner::Settings refinerSettings;
+			refinerSettings.numSteps = settings.memeticSteps;
+			refinerSettings.stepSize = settings.memeticStepSize;
+			refinerSettings.perturbation = settings.memeticPerturbation;
+			refinerSettings.minWeight = settings.minWeight;
+			refinerSettings.maxWeight = settings.maxWeight;
+
+			const int numElites = std::min(settings.memeticEliteCount, (int) io_organisms.size());
+			std::vector<std::future<void>> futures;
+
+			for (int j = 0; j < numElites; j++)
+			{
+				auto* elite = io_organisms.at(j).get();
+
+				futures.emplace_back(workers.push(
+					[this, elite, in_epoch, j, &refinerSettings] (int in_worker)
+				{
+					// slots past the population, so they never collide with children
+					if (settings.deterministic)
+					{
+						UserRNG::Seed(settings.seed, in_epoch, settings.numPopulation + j);
+					}
+
+					BaseType& base = *elite->GetBase();
+					const ParamsType original = base.Parameters();
+
+					const FitnessContext context{arenas.at(in_worker)->GetResource(), in_worker};
+
+					auto surrogateFn = [this, &context] (BaseType& in_base)
+					{
+						return refinementFn ? refinementFn(in_base) : Evaluate(in_base, context);
+					};
+
+					numRefinementEvaluations += MemeticRefiner::Refine(base, surrogateFn, refinerSettings);
+
+					const double refinedFitness = Evaluate(base, context);
+					numEvaluations++;
+
+					if (!settings.memeticLamarckian || (refinedFitness <= elite->GetFitness()))
+					{
+						base.Parameters() = original;
+					}
+
+					elite->SetFitness(std::max(refinedFitness, elite->GetFitness()));
+				} ));
+			}
+
+			for (auto& it : futures)
+			{
+				it.get();
+			}
+
+			if (settings.memeticLamarckian)
+			{
+				for (int j = 0; j < numElites; j++)
+				{
+					auto* elite = io_organisms.at(j).get();
+					const auto& params = elite->GetBase()->Parameters();
+					io_genomeIndex.Insert(elite, io_genomeIndex.ComputeSignature(params), params);
+				}
+			}
+
+			Log( "refined elites: ", numElites,
+				 " surrogate evaluations ", numRefinementEvaluations.load() );
+		}
+	}
+
+	// copies the kept organisms over the fresh random ones and rescores the
+	// elite on the worker pool. Rescoring draws no random numbers, so
+	// deterministic runs stay reproducible.
+	template<class Organisms>
+	void RestoreKeptPopulation(Organisms& io_organisms, int in_numOrganismsSave)
+	{
+		const size_t numKept = std::min(keptPopulation.size(), io_organisms.size());
+		if (numKept == 0)
+		{
+			return;
+		}
+
+		for (size_t j = 0; j < numKept; j++)
+		{
+			// assign in place, mlpack layers alias the parameter memory
+			io_organisms.at(j)->GetBase()->Parameters() = keptPopulation.at(j).parameters;
+			io_organisms.at(j)->SetFitness(keptPopulation.at(j).fitness);
+		}
+
+		const size_t numElites = std::min<size_t>(numKept,
+			(settings.continuousEliteCount > 0) ? settings.continuousEliteCount : in_numOrganismsSave );
+
+		if (rescoreFn)
+		{
+			std::vector<std::future<void>> futures;
+			futures.reserve(numElites);
+
+			for (size_t j = 0; j < numElites; j++)
+			{
+				auto* elite = io_organisms.at(j).get();
+
+				futures.emplace_back(workers.push([this, elite] (int)
+				{
+					elite->SetFitness(rescoreFn(*elite->GetBase(), elite->GetFitness()));
+				} ));
+			}
+
+			for (auto& it : futures)
+			{
+				it.get();
+			}
+		}
+
+		Log( "continuing: kept ", numKept, " rescored ", rescoreFn ? numElites : 0);
+	}
+
+	// passes the context to fitness functions that take one
+	FitnessType Evaluate(BaseType& io_base, const FitnessContext& in_context) const
+	{
+		if constexpr (std::is_invocable<const FitnessFn&, BaseType&, const FitnessContext&>::value)
+		{
+			return fitnessFn(io_base, in_context);
+		}
+		else
+		{
+			return fitnessFn(io_base);
+		}
+	}
+
+	// fresh arenas for every run, settings.arenaBytes may have changed
+	void PrepareArenas()
+	{
+		arenas.clear();
+		for (size_t i = 0; i < workers.size(); i++)
+		{
+			arenas.emplace_back(std::make_unique<EpochArena>(settings.arenaBytes));
+		}
+		arenaStats = EpochArena::Stats();
+	}
+
+	// at the epoch boundary, no task holds arena memory any more
+	void ResetArenas()
+	{
+		EpochArena::Stats epochStats;
+		for (auto& it : arenas)
+		{
+			epochStats += it->GetStats();
+			it->Reset();
+		}
+		arenaStats += epochStats;
+
+		Log( "arena: allocations ", epochStats.numAllocations,
+			 " bytes ", epochStats.numBytes,
+			 " heap allocations ", epochStats.numHeapAllocations );
+	}
+
+	// waits for the children submitted to the remote evaluators, in slot
+	// order. Slots skipped because the run was stopping have no future.
+	template<class Organisms>
+	void CollectRemoteFitness(
+		Organisms& io_organisms,
+		std::vector<std::future<double>>& io_remoteFitness,
+		int in_firstChild )
+	{
+		if constexpr (std::is_arithmetic<FitnessType>::value)
+		{
+			for (size_t j = in_firstChild; j < io_organisms.size(); j++)
+			{
+				if (io_remoteFitness.at(j).valid())
+				{
+					io_organisms.at(j)->SetFitness(io_remoteFitness.at(j).get());
+					numEvaluations++;
+				}
+			}
+		}
+	}
+
+	// trains the surrogate on this epoch's children, in slot order so
+	// deterministic runs refit the same model, and scores the predictions
+	// it made for them
+	template<class Organisms>
+	void UpdateSurrogate(
+		SurrogateModel& io_surrogate,
+		const Organisms& in_organisms,
+		const std::vector<arma::vec>& in_childFeatures,
+		const std::vector<double>& in_childPredictions,
+		int in_firstChild )
+	{
+		std::vector<double> predicted;
+		std::vector<double> actual;
+
+		for (size_t j = in_firstChild; j < in_organisms.size(); j++)
+		{
+			// not evaluated, the run was stopping
+			if (in_childFeatures.at(j).is_empty())
+			{
+				continue;
+			}
+
+			const double fitness = PrimaryFitness(in_organisms.at(j)->GetFitness());
+			io_surrogate.AddSample(in_childFeatures.at(j), fitness);
+
+			if (!std::isnan(in_childPredictions.at(j)) && std::isfinite(fitness))
+			{
+				predicted.push_back(in_childPredictions.at(j));
+				actual.push_back(fitness);
+			}
+		}
+
+		if (io_surrogate.GetNumSamples() >= settings.surrogateMinSamples)
+		{
+			io_surrogate.Fit();
+		}
+
+		surrogateCorrelation = (predicted.size() > 1)
+			? arma::as_scalar(arma::cor(arma::vec(predicted), arma::vec(actual)))
+			: std::numeric_limits<double>::quiet_NaN();
+
+		Log( "surrogate: samples ", io_surrogate.GetNumSamples(),
+			 " correlation ", surrogateCorrelation,
+			 " evaluations saved ", numEvaluationsSaved.load() );
+	}
+
+	// readers keep their copy alive through the shared_ptr, so publishing
+	// never waits on them
+	void PublishElite(const ParamsType& in_weights, const FitnessType& in_fitness, int in_epoch)
+	{
+		auto snapshot = std::make_shared<EliteSnapshot>(EliteSnapshot{
+			in_epoch,
+			numEvaluations,
+			ElapsedSeconds(),
+			in_fitness,
+			in_weights });
+
+		std::atomic_store(&eliteSnapshot, std::shared_ptr<const EliteSnapshot>(std::move(snapshot)));
+	}
+
+	// best first, by fitness or by (front, crowding distance) when the
+	// fitness function returns several objectives
+	template<class Organisms, class CmpFn>
+	void SortOrganisms(Organisms& io_organisms, const CmpFn& in_fitnessCmpFn)
+	{
+		if constexpr (IsObjectiveVector<FitnessType>::value)
+		{
+			std::vector<FitnessType> objectives;
+			objectives.reserve(io_organisms.size());
+			for (auto& it : io_organisms)
+			{
+				objectives.push_back(it->GetFitness());
+			}
+
+			Organisms sorted;
+			sorted.reserve(io_organisms.size());
+			for (size_t index : RankByDominance(objectives))
+			{
+				sorted.emplace_back(std::move(io_organisms[index]));
+			}
+			io_organisms.swap(sorted);
+		}
+		else
+		{
+			std::sort(io_organisms.begin(), io_organisms.end(), in_fitnessCmpFn);
+		}
+	}
+
+	void AddToFingerprint(const ParamsType& in_weights, const FitnessType& in_fitness)
+	{
+		runFingerprint = HashBytes(
+			GenomeData(in_weights), GenomeSize(in_weights) * sizeof(*GenomeData(in_weights)), runFingerprint);
+		runFingerprint = HashBytes(&in_fitness, sizeof(in_fitness), runFingerprint);
+	}
+
+	void LogFingerprint()
+	{
+		char buf[32];
+		snprintf(buf, 32, "%016llx", (unsigned long long) runFingerprint);
+		Log( "run fingerprint: ", buf);
+	}
+
+	// drives a SearchStrategy with the same worker pool, budgets and elite
+	// snapshots as the genetic search
+	void _RunStrategy()
+	{
+		if constexpr (!std::is_same<ParamsType, arma::mat>::value ||
+		              IsObjectiveVector<FitnessType>::value )
+		{
+			ReportFatalError("error, CMA-ES and DE need double weights and a single fitness");
+		}
+		else
+		{
+			runStart = Clock::now();
+			numEvaluations = 0;
+			numRefinementEvaluations = 0;
+			std::atomic_store(&eliteSnapshot, std::shared_ptr<const EliteSnapshot>());
+
+			// one network per candidate, only their weights get overwritten
+			std::vector<std::unique_ptr<BaseType>> candidateBases;
+			candidateBases.emplace_back(createFn());
+
+			const size_t dimension = candidateBases.at(0)->Parameters().n_elem;
+
+			std::unique_ptr<SearchStrategy> strategy;
+			if (settings.searchType == SearchType::CmaEs)
+			{
+				strategy = std::make_unique<CmaEsStrategy>(
+					dimension, settings.numPopulation,
+					settings.minWeight, settings.maxWeight, settings.cmaSigma );
+			}
+			else
+			{
+				strategy = std::make_unique<DifferentialEvolutionStrategy>(
+					dimension, settings.numPopulation,
+					settings.minWeight, settings.maxWeight,
+					settings.deScale, settings.deCrossover );
+			}
+
+			Log( "search: ", strategy->Name());
+
+			PrepareArenas();
+
+			arma::mat candidates;
+			arma::vec fitness;
+			arma::mat bestWeights;
+			double bestFitness = -std::numeric_limits<double>::infinity();
+			int numEpochsWithoutGain = 0;
+
+			std::vector<std::future<void>> futures;
+
+			for (int i = 0; i < settings.numEpoch; i++)
+			{
+				strategy->Ask(candidates);
+				fitness.set_size(candidates.n_cols);
+
+				while (candidateBases.size() < candidates.n_cols)
+				{
+					candidateBases.emplace_back(createFn());
+				}
+
+				// the whole batch is published at once and collected in order
+				if (remoteEvaluator)
+				{
+					auto remoteFitness = remoteEvaluator->SubmitBatch(candidates);
+					for (arma::uword k = 0; k < candidates.n_cols; k++)
+					{
+						fitness[k] = remoteFitness.at(k).get();
+						numEvaluations++;
+					}
+				}
+				else
+				{
+					for (arma::uword k = 0; k < candidates.n_cols; k++)
+					{
+						futures.emplace_back(workers.push(
+							[this, &candidates, &candidateBases, &fitness, k] (int in_worker)
+						{
+							BaseType& base = *candidateBases.at(k);
+
+							// copy in place, mlpack layers alias the parameter memory
+							std::copy(candidates.colptr(k), candidates.colptr(k) + candidates.n_rows,
+							          base.Parameters().memptr() );
+
+							fitness[k] = Evaluate(base, FitnessContext{arenas.at(in_worker)->GetResource(), in_worker});
+							numEvaluations++;
+						} ));
+					}
+				}
+
+				for (auto& it : futures)
+				{
+					it.get();
+				}
+				futures.clear();
+				ResetArenas();
+
+				strategy->Tell(candidates, fitness);
+
+				const arma::uword best = fitness.index_max();
+				if (fitness[best] > bestFitness + settings.plateauTolerance)
+				{
+					numEpochsWithoutGain = 0;
+				}
+				else
+				{
+					numEpochsWithoutGain++;
+				}
+
+				if (fitness[best] > bestFitness)
+				{
+					bestFitness = fitness[best];
+					bestWeights = candidates.col(best);
+				}
+
+				Log( "epoch: ", i,
+					 " best: ", FormatFitness(bestFitness),
+					 " epoch best: ", FormatFitness(fitness[best]),
+					 " evaluations: ", numEvaluations.load() );
+
+				PublishElite(bestWeights, bestFitness, i);
+
+				if (const char* reason = StopReason(numEpochsWithoutGain, candidates.n_cols))
+				{
+					Log( "stopping early: ", reason);
+					break;
+				}
+			}
+
+			Log( "completed");
+
+			auto& bestBase = candidateBases.at(0);
+			std::copy(bestWeights.begin(), bestWeights.end(), bestBase->Parameters().memptr());
+
+			runFingerprint = HashBytes(nullptr, 0);
+			AddToFingerprint(bestBase->Parameters(), bestFitness);
+			LogFingerprint();
+
+			bestPerformer = std::move(bestBase);
+		}
+	}
 };
 
 #endif
@@ -0,0 +1,104 @@
+#ifndef GENOME_H
+#define GENOME_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <type_traits>
+
+#include <mlpack/prereqs.hpp>
+
+// raw access to the weights returned by BaseType::Parameters(), for code
+// that works on any genome as a flat array (hashing, surrogates, export)
+
+template <class T>
+const T* GenomeData(const arma::Mat<T>& in_params) { return in_params.memptr(); }
+
+template <class T>
+T* GenomeData(arma::Mat<T>& in_params) { return in_params.memptr(); }
+
+template <class T>
+size_t GenomeSize(const arma::Mat<T>& in_params) { return in_params.n_elem; }
+
+template <class T>
+bool SaveGenome(const arma::Mat<T>& in_params, const std::string& in_fileName)
+{
+	return in_params.save(in_fileName, arma::arma_binary);
+}
+
+template <class T>
+bool LoadGenome(arma::Mat<T>& out_params, const std::string& in_fileName)
+{
+	return out_params.load(in_fileName, arma::arma_binary);
+}
+
+template <class T>
+const arma::Mat<T>& FormatGenome(const arma::Mat<T>& in_params) { return in_params; }
+
+// Genomes whose size is part of the type, like std::array<uint8_t, 81> for
+// a sudoku grid. Their operators loop a compile time count, so they unroll
+// and vectorize, and they live inside the organism instead of on the heap,
+// see Organism.
+
+template <class Params>
+struct FixedGenomeSize : std::integral_constant<size_t, 0> {};
+
+template <class T, size_t N>
+struct FixedGenomeSize<std::array<T, N>> : std::integral_constant<size_t, N> {};
+
+template <class Params>
+struct IsFixedGenome : std::bool_constant<(FixedGenomeSize<Params>::value > 0)> {};
+
+template <class T, size_t N>
+const T* GenomeData(const std::array<T, N>& in_params) { return in_params.data(); }
+
+template <class T, size_t N>
+T* GenomeData(std::array<T, N>& in_params) { return in_params.data(); }
+
+template <class T, size_t N>
+constexpr size_t GenomeSize(const std::array<T, N>&) { return N; }
+
+// raw values, the size is known to the reader
+template <class T, size_t N>
+bool SaveGenome(const std::array<T, N>& in_params, const std::string& in_fileName)
+{
+	std::ofstream file(in_fileName, std::ios::binary);
+	file.write(reinterpret_cast<const char*>(in_params.data()), sizeof(T) * N);
+	return file.good();
+}
+
+template <class T, size_t N>
+bool LoadGenome(std::array<T, N>& out_params, const std::string& in_fileName)
+{
+	std::ifstream file(in_fileName, std::ios::binary);
+	file.read(reinterpret_cast<char*>(out_params.data()), sizeof(T) * N);
+	return file.good();
+}
+
+// small integer types would print as characters
+template <class T, size_t N>
+std::string FormatGenome(const std::array<T, N>& in_params)
+{
+	std::string text;
+	for (auto& it : in_params)
+	{
+		text += std::to_string(+it) + " ";
+	}
+	return text;
+}
+
+// FNV-1a, in_hash chains several calls together
+inline uint64_t HashBytes(const void* in_data, size_t in_size,
+                          uint64_t in_hash = 14695981039346656037ull)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(in_data);
+	for (size_t i = 0; i < in_size; i++)
+	{
+		in_hash = (in_hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return in_hash;
+}
+
+#endif
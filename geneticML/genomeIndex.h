@@ -0,0 +1,319 @@
+#ifndef GENOMEINDEX_H
+#define GENOMEINDEX_H
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "util.h"
+#include "genome.h"
+
+struct GenomeSignature
+{
+	// hash of the exact weights
+	uint64_t exact = 0;
+
+	// one bit per random hyperplane, close genomes differ in few bits
+	uint64_t simHash = 0;
+};
+
+// Population-wide index of genome signatures, used to spot exact and near
+// duplicate genomes without comparing the weights pairwise.
+//
+// Near duplicates are found with LSH banding: the 64 bit SimHash is split in
+// nearDistance + 1 bands and only genomes sharing a band are compared. Two
+// genomes within the distance differ in at most nearDistance bits, so at
+// least one band is untouched and every near duplicate is found. Larger
+// distances mean narrower bands and fuller buckets.
+//
+// Entries are keyed by organism, so a child that replaces a culled organism
+// replaces its entry. An exact hash match is confirmed against the indexed
+// weights, which are not copied: they have to stay in place and unchanged
+// until the entry is removed or inserted again. The const members are safe to
+// call from several threads as long as no thread modifies the index at the
+// same time.
+class GenomeIndex
+{
+using Key = const void*;
+
+static constexpr int NumBits = 64;
+static constexpr int MaxNicheCount = 256;
+
+public:
+	struct Diversity
+	{
+		// distinct genomes / population
+		double uniqueFraction = 1.0;
+
+		// distinct SimHash values / population
+		double nicheFraction = 1.0;
+	};
+
+	// in_center is subtracted from every weight before the projection, so
+	// genomes with only positive weights still spread over the hyperplanes.
+	// in_nearDistance is clamped to [0, 63], one band per bit at most.
+	GenomeIndex(size_t in_genomeSize, double in_center, int in_nearDistance)
+	:genomeSize(in_genomeSize)
+	,center(in_center)
+	,nearDistance(std::clamp(in_nearDistance, 0, NumBits - 1))
+	,numBands(nearDistance + 1)
+	,bandBits(NumBits / numBands)
+	,hyperplanes(NumBits * in_genomeSize)
+	,bands(numBands)
+	{
+		// fixed seed, signatures must not depend on the run's rng
+		std::mt19937_64 planeRng(NumBits * in_genomeSize);
+		std::normal_distribution<float> normal;
+
+		for (auto& it : hyperplanes)
+		{
+			it = normal(planeRng);
+		}
+	}
+
+	template<class Params>
+	GenomeSignature ComputeSignature(const Params& in_params) const
+	{
+		const auto* weights = GenomeData(in_params);
+
+		if (GenomeSize(in_params) != genomeSize)
+		{
+			ReportFatalError("error, genome size does not match the index");
+		}
+
+		GenomeSignature signature;
+
+		signature.exact = HashBytes(weights, genomeSize * sizeof(*weights));
+
+		for (int b = 0; b < NumBits; b++)
+		{
+			const float* plane = &hyperplanes[b * genomeSize];
+			double dot = 0.0;
+
+			for (size_t i = 0; i < genomeSize; i++)
+			{
+				dot += plane[i] * (weights[i] - center);
+			}
+
+			signature.simHash |= (uint64_t)(dot >= 0.0) << b;
+		}
+
+		return signature;
+	}
+
+	// in_signature is ComputeSignature(in_params)
+	template<class Params>
+	void Insert(Key in_key, const GenomeSignature& in_signature, const Params& in_params)
+	{
+		Remove(in_key);
+
+		entries.emplace(in_key, Entry{in_signature, GenomeData(in_params), WeightBytes(in_params)});
+		exactKeys[in_signature.exact].push_back(in_key);
+		simHashCounts[in_signature.simHash]++;
+
+		for (int band = 0; band < numBands; band++)
+		{
+			bands[band][BandValue(in_signature.simHash, band)].push_back(in_key);
+		}
+	}
+
+	void Remove(Key in_key)
+	{
+		auto entry = entries.find(in_key);
+		if (entry == entries.end())
+		{
+			return;
+		}
+
+		const GenomeSignature signature = entry->second.signature;
+		entries.erase(entry);
+
+		RemoveKey(exactKeys, signature.exact, in_key);
+		DecrementCount(simHashCounts, signature.simHash);
+
+		for (int band = 0; band < numBands; band++)
+		{
+			RemoveKey(bands[band], BandValue(signature.simHash, band), in_key);
+		}
+	}
+
+	// exact copy of an indexed genome, or within the near duplicate distance.
+	// in_signature is ComputeSignature(in_params).
+	template<class Params>
+	bool IsDuplicate(const GenomeSignature& in_signature, const Params& in_params) const
+	{
+		if (CountExact(in_signature.exact, GenomeData(in_params), WeightBytes(in_params), 1) != 0)
+		{
+			return true;
+		}
+
+		return (nearDistance > 0) && (CountNear(in_signature, 1) != 0);
+	}
+
+	// number of indexed genomes within the near duplicate distance of the
+	// entry, itself included, capped at MaxNicheCount
+	int NicheCount(Key in_key) const
+	{
+		auto entry = entries.find(in_key);
+		if (entry == entries.end())
+		{
+			return 1;
+		}
+
+		if (nearDistance == 0)
+		{
+			const Entry& it = entry->second;
+			return std::max(CountExact(it.signature.exact, it.weights, it.weightBytes, MaxNicheCount), 1);
+		}
+
+		return std::max(CountNear(entry->second.signature, MaxNicheCount), 1);
+	}
+
+	Diversity GetDiversity() const
+	{
+		Diversity diversity;
+		if (!entries.empty())
+		{
+			diversity.uniqueFraction = (double) exactKeys.size() / entries.size();
+			diversity.nicheFraction = (double) simHashCounts.size() / entries.size();
+		}
+		return diversity;
+	}
+
+private:
+	size_t genomeSize;
+	double center;
+	int nearDistance;
+	int numBands;
+	int bandBits;
+	std::vector<float> hyperplanes;
+
+	struct Entry
+	{
+		GenomeSignature signature;
+		const void* weights;
+		size_t weightBytes;
+	};
+
+	std::unordered_map<Key, Entry> entries;
+	std::unordered_map<uint64_t, std::vector<Key>> exactKeys;
+	std::unordered_map<uint64_t, int> simHashCounts;
+	std::vector<std::unordered_map<uint64_t, std::vector<Key>>> bands;
+
+	// the last band also takes the bits left over by the division
+	uint64_t BandValue(uint64_t in_simHash, int in_band) const
+	{
+		const int shift = in_band * bandBits;
+		const int width = (in_band == numBands - 1) ? NumBits - shift : bandBits;
+		const uint64_t mask = (width == NumBits) ? ~0ull : (1ull << width) - 1;
+
+		return (in_simHash >> shift) & mask;
+	}
+
+	static void DecrementCount(std::unordered_map<uint64_t, int>& io_counts, uint64_t in_value)
+	{
+		auto it = io_counts.find(in_value);
+		if (--(it->second) == 0)
+		{
+			io_counts.erase(it);
+		}
+	}
+
+	static void RemoveKey(std::unordered_map<uint64_t, std::vector<Key>>& io_buckets, uint64_t in_value, Key in_key)
+	{
+		auto bucket = io_buckets.find(in_value);
+		auto& keys = bucket->second;
+
+		keys.erase(std::find(keys.begin(), keys.end(), in_key));
+		if (keys.empty())
+		{
+			io_buckets.erase(bucket);
+		}
+	}
+
+	template<class Params>
+	size_t WeightBytes(const Params& in_params) const
+	{
+		return genomeSize * sizeof(*GenomeData(in_params));
+	}
+
+	// counts indexed genomes with exactly in_weights, the hash only picks the
+	// ones to compare. Stops at in_limit.
+	int CountExact(uint64_t in_exact, const void* in_weights, size_t in_weightBytes, int in_limit) const
+	{
+		auto bucket = exactKeys.find(in_exact);
+		if (bucket == exactKeys.end())
+		{
+			return 0;
+		}
+
+		int count = 0;
+
+		for (Key key : bucket->second)
+		{
+			const Entry& entry = entries.at(key);
+
+			if ((entry.weightBytes == in_weightBytes) &&
+			    (memcmp(entry.weights, in_weights, in_weightBytes) == 0) &&
+			    (++count >= in_limit) )
+			{
+				break;
+			}
+		}
+
+		return count;
+	}
+
+	// counts indexed genomes within nearDistance, stopping at in_limit
+	int CountNear(const GenomeSignature& in_signature, int in_limit) const
+	{
+		int count = 0;
+
+		for (int band = 0; band < numBands && count < in_limit; band++)
+		{
+			auto bucket = bands[band].find(BandValue(in_signature.simHash, band));
+			if (bucket == bands[band].end())
+			{
+				continue;
+			}
+
+			for (Key key : bucket->second)
+			{
+				uint64_t diff = entries.at(key).signature.simHash ^ in_signature.simHash;
+
+				// genomes sharing an earlier band were already counted there
+				if (EarlierBandMatches(diff, band) ||
+				    ((int) std::bitset<NumBits>(diff).count() > nearDistance) )
+				{
+					continue;
+				}
+
+				if (++count >= in_limit)
+				{
+					break;
+				}
+			}
+		}
+
+		return count;
+	}
+
+	bool EarlierBandMatches(uint64_t in_diff, int in_band) const
+	{
+		for (int band = 0; band < in_band; band++)
+		{
+			if (BandValue(in_diff, band) == 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+#endif
@@ -0,0 +1,205 @@
+#ifndef LSTMINFERENCE_H
+#define LSTMINFERENCE_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <string>
+
+#include "util.h"
+#include "genome.h"
+
+// Steps a trained network one tick at a time, keeping the LSTM hidden and
+// cell state between calls instead of predicting over the whole series.
+//
+// The topology is fixed at compile time and matches the networks built by
+// createRNN() in main.cpp:
+//   LinearNoBias(Inputs, Hidden)
+//   NumHiddenLstm x LSTM(Hidden, Hidden)
+//   LSTM(Hidden, Outputs)
+//   Sigmoid
+// All buffers are members, Step() does not allocate.
+//
+// The parameters are read in the order mlpack's RNN lays them out: layer by
+// layer, and for each LSTM (with peepholes) the input weights (4*out x in),
+// the gate biases (4*out), the recurrent weights (4*out x out) and the
+// peephole weights (3*out). Gate rows are input, forget, output, cell.
+//
+// A network trained with rho == 1 starts every prediction from an empty
+// state, call ResetState() before each Step() to reproduce those outputs.
+template <size_t Inputs, size_t Hidden, size_t Outputs, size_t NumHiddenLstm>
+class LstmInferenceEngine
+{
+template <size_t In, size_t Out>
+class LstmLayer
+{
+public:
+	static constexpr size_t NumParameters = 4*Out*In + 4*Out + 4*Out*Out + 3*Out;
+
+	const double* SetParameters(const double* in_params)
+	{
+		in_params = Copy(in_params, input2GateWeight);
+		in_params = Copy(in_params, input2GateBias);
+		in_params = Copy(in_params, output2GateWeight);
+		return Copy(in_params, cell2GateWeight);
+	}
+
+	void ResetState()
+	{
+		output.fill(0.0);
+		cell.fill(0.0);
+	}
+
+	const std::array<double, Out>& Step(const std::array<double, In>& in_input)
+	{
+		gate = input2GateBias;
+
+		// column major, like the arma::mat aliases inside mlpack
+		for (size_t c = 0; c < In; c++)
+		{
+			for (size_t r = 0; r < 4*Out; r++)
+			{
+				gate[r] += input2GateWeight[c * 4*Out + r] * in_input[c];
+			}
+		}
+
+		for (size_t c = 0; c < Out; c++)
+		{
+			for (size_t r = 0; r < 4*Out; r++)
+			{
+				gate[r] += output2GateWeight[c * 4*Out + r] * output[c];
+			}
+		}
+
+		for (size_t i = 0; i < Out; i++)
+		{
+			const double inputGate = Sigmoid(gate[i] + cell2GateWeight[i] * cell[i]);
+			const double forgetGate = Sigmoid(gate[Out + i] + cell2GateWeight[Out + i] * cell[i]);
+
+			cell[i] = forgetGate * cell[i] + inputGate * std::tanh(gate[3*Out + i]);
+
+			const double outputGate = Sigmoid(gate[2*Out + i] + cell2GateWeight[2*Out + i] * cell[i]);
+			output[i] = outputGate * std::tanh(cell[i]);
+		}
+
+		return output;
+	}
+
+private:
+	std::array<double, 4*Out*In> input2GateWeight;
+	std::array<double, 4*Out> input2GateBias;
+	std::array<double, 4*Out*Out> output2GateWeight;
+	std::array<double, 3*Out> cell2GateWeight;
+
+	std::array<double, 4*Out> gate;
+	std::array<double, Out> output;
+	std::array<double, Out> cell;
+};
+
+public:
+	using Input = std::array<double, Inputs>;
+	using Output = std::array<double, Outputs>;
+
+	static constexpr size_t NumParameters =
+		Hidden * Inputs +
+		NumHiddenLstm * LstmLayer<Hidden, Hidden>::NumParameters +
+		LstmLayer<Hidden, Outputs>::NumParameters;
+
+	LstmInferenceEngine()
+	{
+		ResetState();
+	}
+
+	// in_params is RNN::Parameters() of a network with this topology
+	explicit LstmInferenceEngine(const arma::mat& in_params)
+	{
+		SetParameters(GenomeData(in_params), GenomeSize(in_params));
+		ResetState();
+	}
+
+	void SetParameters(const double* in_params, size_t in_size)
+	{
+		if (in_size != NumParameters)
+		{
+			ReportFatalError("error, parameter count does not match the inference topology");
+		}
+
+		in_params = Copy(in_params, inputWeight);
+		for (auto& it : hiddenLayers)
+		{
+			in_params = it.SetParameters(in_params);
+		}
+		outputLayer.SetParameters(in_params);
+	}
+
+	// reads a genome written by GeneticAlgoTrainer::ExportBestPerformer()
+	bool LoadFromFile(const std::string& in_fileName)
+	{
+		arma::mat params;
+		if (!LoadGenome(params, in_fileName))
+		{
+			return false;
+		}
+
+		SetParameters(GenomeData(params), GenomeSize(params));
+		ResetState();
+		return true;
+	}
+
+	void ResetState()
+	{
+		for (auto& it : hiddenLayers)
+		{
+			it.ResetState();
+		}
+		outputLayer.ResetState();
+	}
+
+	// advances the network by one tick and returns the sigmoid outputs
+	const Output& Step(const Input& in_input)
+	{
+		for (size_t r = 0; r < Hidden; r++)
+		{
+			hiddenInput[r] = 0.0;
+			for (size_t c = 0; c < Inputs; c++)
+			{
+				hiddenInput[r] += inputWeight[c * Hidden + r] * in_input[c];
+			}
+		}
+
+		const std::array<double, Hidden>* layerInput = &hiddenInput;
+		for (auto& it : hiddenLayers)
+		{
+			layerInput = &it.Step(*layerInput);
+		}
+
+		const auto& lstmOutput = outputLayer.Step(*layerInput);
+		for (size_t i = 0; i < Outputs; i++)
+		{
+			output[i] = Sigmoid(lstmOutput[i]);
+		}
+
+		return output;
+	}
+
+private:
+	std::array<double, Hidden * Inputs> inputWeight;
+	std::array<double, Hidden> hiddenInput;
+	std::array<LstmLayer<Hidden, Hidden>, NumHiddenLstm> hiddenLayers;
+	LstmLayer<Hidden, Outputs> outputLayer;
+	Output output;
+
+	static double Sigmoid(double in_x)
+	{
+		return 1.0 / (1.0 + std::exp(-in_x));
+	}
+
+	template <size_t N>
+	static const double* Copy(const double* in_params, std::array<double, N>& out_values)
+	{
+		std::copy(in_params, in_params + N, out_values.begin());
+		return in_params + N;
+	}
+};
+
+#endif
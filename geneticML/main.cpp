@@ -2,6 +2,13 @@
 #include "userRNG.h"
 #include "organism.h"
 #include "geneticAlgoTrainer.h"
+#include "backtestEngine.h"
+#include "validationEngine.h"
+#include "lstmInference.h"
+#include "remoteEvaluator.h"
+#include "datasetRegistry.h"
+#include "trainingJobRunner.h"
+#include "tickStream.h"
 
 #include <mlpack/core/optimizers/rmsprop/rmsprop.hpp>
 
@@ -24,20 +31,28 @@
 #include <mlpack/methods/ann/layer/concat.hpp>
 #include <mlpack/methods/ann/layer/atrous_convolution.hpp>
 
+#include <array>
+#include <chrono>
 #include <functional>
+#include <thread>
 
 using namespace mlpack::ann;
 
 using RnnType = RNN<SigmoidLayer<>>;
 
+// per tick inference for the createRNN() topology below
+using RnnInference = LstmInferenceEngine<1, 6, 2, 3>;
+
+// 9x9 grid, column major like the arma::Mat<int> it replaced. The size is
+// part of the type, so the trainer takes the fixed genome path.
 class SudokuSolution
 {
-using DataType = arma::Mat<int>;
+using DataType = std::array<uint8_t, 81>;
 public:
 	DataType& Parameters() { return solution; }
 	SudokuSolution() 
+	:solution()
 	{
-		solution = DataType(9, 9);
 	}
 
 private:
@@ -51,48 +66,34 @@ void RunSudoku()
 		return new SudokuSolution();
 	};
 
+	// one bit per digit, the number of distinct digits in a row, column or
+	// square is the popcount of its mask
 	auto calculateFitness = [] (SudokuSolution& in_solution)
 	{
-		double retFitness = 0.0;
-		auto& cells = in_solution.Parameters();
-		std::set<int> uniqueValues;
+		const auto& cells = in_solution.Parameters();
 
-		for (int i = 0; i < 9; i++)
-		{
+		std::array<uint16_t, 9> rowMasks = {};
+		std::array<uint16_t, 9> colMasks = {};
+		std::array<uint16_t, 9> squareMasks = {};
 
-			for (auto& it : cells.row(i))
+		for (int col = 0; col < 9; col++)
+		{
+			for (int row = 0; row < 9; row++)
 			{
-				uniqueValues.insert(it);
-			}
-			//todo perf test with loop configs
-
-			retFitness += uniqueValues.size();
-
-			uniqueValues.clear();
+				const uint16_t bit = 1 << cells[col * 9 + row];
 
-			for (auto& it : cells.col(i))
-			{
-				uniqueValues.insert(it);
+				rowMasks[row] |= bit;
+				colMasks[col] |= bit;
+				squareMasks[(row / 3) * 3 + col / 3] |= bit;
 			}
-
-			retFitness += uniqueValues.size();
-			uniqueValues.clear();
 		}
 
-		for (int j = 0; j < 3; j++)
+		double retFitness = 0.0;
+		for (int i = 0; i < 9; i++)
 		{
-			for (int k = 0; k < 3; k++)
-			{
-				arma::subview<int> square = cells.submat(j*3, k*3, arma::SizeMat(3, 3));
-
-				for (auto& it : square)
-				{
-					uniqueValues.insert(it);
-				}
-                
-                retFitness += uniqueValues.size();
-                uniqueValues.clear();
-			}
+			retFitness += __builtin_popcount(rowMasks[i]);
+			retFitness += __builtin_popcount(colMasks[i]);
+			retFitness += __builtin_popcount(squareMasks[i]);
 		}
 
 		return retFitness;
@@ -104,90 +105,334 @@ void RunSudoku()
 	settings.maxWeight = 9;
     settings.numEpoch = 100000;
 	settings.useIntType = true;
+	settings.rejectDuplicates = true;
     trainer.Run();
+
+    Log ("evaluations: ", trainer.GetNumEvaluations());
 }
 
-int main()
+RnnType* CreateRNN()
 {
-    const arma::cube trainData = GetInputDataExitOnError(
-            "/Users/tkgendro/projects/geneticML/geneticML/trainData.json" );
+    auto pRnn = std::make_unique<RnnType>(1);
     
-    const arma::cube testData = GetInputDataExitOnError(
-            "/Users/tkgendro/projects/geneticML/geneticML/testData.json");
+    int inputs = 1;
+    int hiddenSize = 6 * inputs;
+    int outputs = 2;
     
-    const arma::cube* dataToUse = &trainData;
+    pRnn->Add<LinearNoBias<> >(1, hiddenSize);
+    pRnn->Add<LSTM<>>(hiddenSize, hiddenSize);
+    pRnn->Add<LSTM<>>(hiddenSize, hiddenSize);
+    pRnn->Add<LSTM<>>(hiddenSize, hiddenSize);
+    pRnn->Add<LSTM<>>(hiddenSize, outputs);
+    pRnn->Add<SigmoidLayer<> >();
+    pRnn->Reset();
     
-    auto createRNN = []()
+    return pRnn.release();
+}
+
+// scores one model on one window of data, safe to call from any worker
+double CalculateFoldFitness(RnnType& in_rnn, const arma::cube& in_data)
+{
+    arma::cube prediction;
+    in_rnn.Predict(in_data, prediction, 1);
+    
+    return BacktestEngine(in_data).Score(prediction);
+}
+
+// trains one model on in_trainData, reports it on in_testData and writes
+// its weights to in_name.bin. in_workers may be shared with other symbols.
+void RunSymbol(
+        const std::string& in_name,
+        const arma::cube& in_trainData,
+        const arma::cube& in_testData,
+        ctpl::thread_pool& in_workers,
+        RemoteEvaluatorPool* in_remoteEvaluator )
+{
+    const auto createRNN = &CreateRNN;
+    const auto calculateFoldFitness = &CalculateFoldFitness;
+    
+    ValidationEngine validation(in_trainData, in_workers);
+    auto calculateFitness = validation.MakeFitnessFn(calculateFoldFitness);
+    
+    GeneticAlgoTrainer trainer(createRNN, calculateFitness, in_workers);
+	auto& settings = trainer.GetSettings();
+	settings.minWeight = -2.0;
+	settings.maxWeight = 2.0;
+	settings.memeticInterval = 5;
+    
+    // smooth version of the trading fitness for the memetic refinement
+    trainer.SetRefinementFn([&in_trainData] (RnnType& in_rnn)
     {
-        auto pRnn = std::make_unique<RnnType>(1);
-        
-        int inputs = 1;
-        int hiddenSize = 6 * inputs;
-        int outputs = 2;
+        arma::cube prediction;
+        in_rnn.Predict(in_trainData, prediction, 1);
         
-        pRnn->Add<LinearNoBias<> >(1, hiddenSize);
-        pRnn->Add<LSTM<>>(hiddenSize, hiddenSize);
-        pRnn->Add<LSTM<>>(hiddenSize, hiddenSize);
-        pRnn->Add<LSTM<>>(hiddenSize, hiddenSize);
-        pRnn->Add<LSTM<>>(hiddenSize, outputs);
-        pRnn->Add<SigmoidLayer<> >();
-        pRnn->Reset();
+        return BacktestEngine(in_trainData).SmoothScore(prediction);
+    });
+    
+    trainer.SetRemoteEvaluator(in_remoteEvaluator);
+    trainer.Run();
+    
+    Log (in_name, " fitness from training data:", calculateFitness(*trainer.GetBestPerformer()) );
+    Log (in_name, " fitness from test data: ", calculateFoldFitness(*trainer.GetBestPerformer(), in_testData) );
+
+    if (!trainer.ExportBestPerformer(in_name + ".bin"))
+    {
+        Log ("error: could not write the best performer: ", in_name, ".bin");
+    }
+
+    // replay the test data one tick at a time, as it would arrive live
+    RnnInference inference(trainer.GetBestPerformer()->Parameters());
+    for (arma::uword i = 0; i < in_testData.n_cols; i++)
+    {
+        inference.ResetState();
+        const auto& decision = inference.Step({in_testData(0, i, 0)});
         
-        return pRnn.release();
-    };
+        if (i == in_testData.n_cols - 1)
+        {
+            Log (in_name, " last tick buy: ", decision[0], " sell: ", decision[1]);
+        }
+    }
+}
+
+// the data of one RunStream() round, shared by that round's fitness and
+// rescore functions. Both cubes alias the ring buffer, which is not appended
+// to until the round is over.
+struct StreamRound
+{
+    StreamRound(const TickRingBuffer& in_buffer, uint64_t in_trainedUpTo, ctpl::thread_pool& in_workers)
+    :window(in_buffer.GetWindow())
+    ,increment(in_buffer.GetIncrement(in_trainedUpTo))
+    ,validation(window, in_workers)
+    {
+    }
     
-    auto calculateFitness = [&dataToUse] (RnnType& in_rnn)
+    const arma::cube window;
+    const arma::cube increment;
+    const ValidationEngine validation;
+};
+
+// keeps one population training on the last bars of in_source, picking up
+// from the previous population whenever enough new bars have arrived, and
+// writes the best weights to streamPerformer.bin after every round
+void RunStream(TickSource& io_source, ctpl::thread_pool& in_workers)
+{
+    const arma::uword windowSize = 2000;
+    const uint64_t minIncrement = 50;
+    
+    TickRingBuffer buffer(windowSize);
+    
+    const auto createRNN = &CreateRNN;
+    const auto calculateFoldFitness = &CalculateFoldFitness;
+    
+    // the trainer keeps a reference, a new round assigns a new function
+    std::function<double(RnnType&)> calculateFitness;
+    
+    GeneticAlgoTrainer trainer(createRNN, calculateFitness, in_workers);
+	auto& settings = trainer.GetSettings();
+	settings.minWeight = -2.0;
+	settings.maxWeight = 2.0;
+	settings.numEpoch = 5;
+	settings.continuous = true;
+    
+    uint64_t trainedUpTo = 0;
+    arma::uword previousWindowSize = 0;
+    
+    while (true)
     {
-        double retFitness = 0.0;
+        const size_t numNew = io_source.Poll(buffer);
         
-        arma::cube prediction;
-        in_rnn.Predict(*dataToUse, prediction, 1);
+        if ((buffer.Size() < windowSize / 2) ||
+            (buffer.GetNumAppended() - trainedUpTo < minIncrement) )
+        {
+            if (io_source.IsFinished())
+            {
+                break;
+            }
+            if (numNew == 0)
+            {
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+            }
+            continue;
+        }
         
-        long long predictSize = arma::size(prediction)[1];
-        double normalizedActualCost = 0.0;
-        bool readyToBuy = true;
+        const auto round = std::make_shared<const StreamRound>(buffer, trainedUpTo, in_workers);
         
-        for (int i = 0; i < predictSize; i++)
+        calculateFitness = [round, calculateFoldFitness] (RnnType& in_rnn)
         {
-            normalizedActualCost += (*dataToUse)(0,i,0);
-            
-            bool buy = prediction(0,i,0) > 0.5;
-            bool sell = prediction(1,i,0) > 0.5;
+            return round->validation.Evaluate(calculateFoldFitness, in_rnn).aggregate;
+        };
+        
+        // the networks run with rho == 1, so no LSTM state carries over
+        // between ticks and only the new ticks need predicting. The mean over
+        // the folds is about the window's P&L over the fold count: the bars
+        // that aged out of the buffer leave it as the new ticks' P&L, spread
+        // over the folds, comes in. That only holds while the folds cover the
+        // same number of bars as last round, so kept organisms are rescored
+        // in full until the buffer is full, and always for the worst fold.
+        trainer.SetRescoreFn([round, calculateFoldFitness, previousWindowSize] (RnnType& in_rnn, const double& in_previous)
+        {
+            const arma::cube& increment = round->increment;
+            const ValidationEngine& validation = round->validation;
             
-            if (readyToBuy && buy)
+            if ((validation.GetSettings().aggregateType != ValidationEngine::AggregateType::Mean) ||
+                (round->window.n_cols != previousWindowSize) )
             {
-                if (!sell)
-                {
-                    // buy
-                    retFitness -= normalizedActualCost;
-                    readyToBuy = false;
-                }
+                return validation.Evaluate(calculateFoldFitness, in_rnn).aggregate;
             }
-            else if (!readyToBuy && sell)
+            
+            arma::cube prediction;
+            in_rnn.Predict(increment, prediction, 1);
+            
+            const auto& folds = validation.GetFolds();
+            const double windowTicks = folds.back().begin + folds.back().count;
+            const double numAgedOut = previousWindowSize + increment.n_cols - round->window.n_cols;
+            const double kept = std::max(0.0, 1.0 - numAgedOut / windowTicks);
+            
+            return in_previous * kept + BacktestEngine(increment).Score(prediction) / folds.size();
+        });
+        
+        trainer.Run();
+        trainedUpTo = buffer.GetNumAppended();
+        previousWindowSize = round->window.n_cols;
+        
+        Log ("stream: trained on ", round->window.n_cols, " bars, ", round->increment.n_cols,
+             " new, last bar at ", buffer.GetLastTime(),
+             " fitness ", trainer.GetEliteSnapshot()->fitness );
+        
+        if (!trainer.ExportBestPerformer("streamPerformer.bin"))
+        {
+            Log ("error: could not write the best performer: streamPerformer.bin");
+        }
+    }
+}
+
+// geneticML --stream FILE
+//     trains continuously on bars appended to FILE, one per line as
+//     "2019-01-02 09:30:00,open,high,low,close,volume". A .json FILE in the
+//     trainData.json format is replayed instead, 100 bars at a time.
+// geneticML [--remote]
+//     trains on trainData.json and tests on testData.json from the working
+//     directory, --remote scores in evaluator processes running this binary
+// geneticML SYMBOL.json...
+//     trains one model per file, holding out the last 20% of each series
+int main(int argc, char** argv)
+{
+    // stub evaluator process started by RemoteEvaluatorPool, scores genomes
+    // with the same fitness as the trainer would in process
+    if ((argc == 4) && (std::string(argv[1]) == "--evaluator"))
+    {
+        // the parent writes the log file, an evaluator exiting would replace it
+        WriteToFileThenDelete::enabled = false;
+        
+        const arma::cube trainData = GetInputDataExitOnError("trainData.json");
+        const auto calculateFoldFitness = &CalculateFoldFitness;
+        
+        // one evaluator runs per core already, so no worker pool here, the
+        // folds of each genome are scored serially on the serving thread
+        ValidationEngine validation(trainData);
+        auto calculateFitness = validation.MakeFitnessFn(calculateFoldFitness);
+        std::unique_ptr<RnnType> rnn(CreateRNN());
+        
+        return RemoteEvaluatorWorker::Serve(argv[2], std::stoi(argv[3]),
+            [&] (const double* in_genome, size_t in_size)
+        {
+            std::copy(in_genome, in_genome + in_size, rnn->Parameters().memptr());
+            return calculateFitness(*rnn);
+        });
+    }
+    
+    if ((argc == 3) && (std::string(argv[1]) == "--stream"))
+    {
+        const std::string fileName = argv[2];
+        std::unique_ptr<TickSource> source;
+        
+        if (std::filesystem::path(fileName).extension() == ".json")
+        {
+            BarsWError bars = GetInputBars(fileName);
+            if (auto* error = std::get_if<ErrMsg>(&bars); error != nullptr)
             {
-                if (!buy)
-                {
-                    // sell
-                    retFitness += normalizedActualCost;
-                    readyToBuy = true;
-                }
+                ReportFatalError(*error);
             }
+            source = std::make_unique<ReplayTickSource>(std::move(std::get<std::vector<Bar>>(bars)), 100);
+        }
+        else
+        {
+            source = std::make_unique<FileTailTickSource>(fileName);
         }
         
-        return retFitness;
-    };
+        ctpl::thread_pool workers(std::thread::hardware_concurrency());
+        RunStream(*source, workers);
+        return 1;
+    }
     
-    //GeneticAlgoTrainer<std::function<RnnType*()>, std::function<double(RnnType&, bool)>> trainer((std::function<RnnType*()>(createRNN)), std::function<double(RnnType&, bool)>(calculateFitness));
-    GeneticAlgoTrainer trainer(createRNN, calculateFitness);
-	auto settings = trainer.GetSettings();
-	settings.minWeight = -2.0;
-	settings.maxWeight = 2.0;
-    trainer.Run();
+    const bool useRemote = (argc >= 2) && (std::string(argv[1]) == "--remote");
+    const std::vector<std::string> symbolFiles(argv + (useRemote ? 2 : 1), argv + argc);
+    
+    DatasetRegistry::Settings registrySettings;
+    registrySettings.cacheDirectory = "datasetCache";
+    DatasetRegistry registry(registrySettings);
+    
+    if (symbolFiles.empty())
+    {
+        auto trainData = registry.GetExitOnError("trainData.json");
+        auto testData = registry.GetExitOnError("testData.json");
+        
+        ctpl::thread_pool workers(std::thread::hardware_concurrency());
+        
+        std::unique_ptr<RemoteEvaluatorPool> remoteEvaluator;
+        if (useRemote)
+        {
+            RemoteEvaluatorPool::Settings remoteSettings;
+            remoteSettings.numWorkers = std::thread::hardware_concurrency();
+            
+            std::unique_ptr<RnnType> rnn(CreateRNN());
+            remoteEvaluator = std::make_unique<RemoteEvaluatorPool>(
+                GenomeSize(rnn->Parameters()), remoteSettings );
+        }
+        
+        RunSymbol("bestPerformer", *trainData, *testData, workers, remoteEvaluator.get());
+        return 1;
+    }
+    
+    // parse everything up front while the first jobs train
+    registry.Prefetch(symbolFiles);
+    
+    TrainingJobRunner runner((TrainingJobRunner::Settings()));
+    for (auto& it : symbolFiles)
+    {
+        runner.Add(it, [&registry, fileName = it] (ctpl::thread_pool& in_workers)
+        {
+            ErrMsg error;
+            auto data = registry.Get(fileName, &error);
+            if (!data)
+            {
+                Log (error);
+                return;
+            }
+            
+            const arma::uword split = data->n_cols * 0.8;
+            if ((split == 0) || (split == data->n_cols))
+            {
+                Log ("error: not enough data in file: ", fileName);
+                return;
+            }
+            
+            // views into the shared series, a single slice like every
+            // GetInputData() cube, so the columns are contiguous
+            double* series = const_cast<double*>(data->memptr());
+            const arma::cube trainData(series, data->n_rows, split, 1, false, true);
+            const arma::cube testData(series + split * data->n_rows,
+                                      data->n_rows, data->n_cols - split, 1, false, true);
+            
+            RunSymbol(std::filesystem::path(fileName).stem().string(),
+                      trainData, testData, in_workers, nullptr);
+        });
+    }
+    runner.RunAll();
+    
+    Log ("datasets parsed: ", registry.GetNumParsed(),
+         " from disk cache: ", registry.GetNumDiskCacheHits(),
+         " duplicates: ", registry.GetNumDuplicates() );
     
-    Log ("fitness from training data:", calculateFitness(*trainer.GetBestPerformer()) );
-    dataToUse = &testData;
-    Log ("fitness from test data: ", calculateFitness(*trainer.GetBestPerformer()) );
-
 	return 1;
 }
-
@@ -0,0 +1,71 @@
+#ifndef MEMETICREFINER_H
+#define MEMETICREFINER_H
+
+#include <mlpack/core/optimizers/rmsprop/rmsprop.hpp>
+
+#include "util.h"
+#include "userRNG.h"
+
+// Short local refinement of one genome by gradient ascent on a smooth
+// surrogate of the fitness, used to polish the elites between epochs.
+//
+// The surrogate is any double(BaseType&) that reads the weights through
+// Parameters(), so the gradient is estimated with SPSA: two surrogate calls
+// per step along a random +-1 direction, whatever the genome size. The step
+// itself is mlpack's RMSProp update.
+class MemeticRefiner
+{
+public:
+	struct Settings
+	{
+		int numSteps = 10;
+		double stepSize = 0.01;
+
+		// SPSA perturbation size
+		double perturbation = 0.01;
+
+		float minWeight = -1.0;
+		float maxWeight = 1.0;
+	};
+
+	// refines in_base's weights in place and returns the number of surrogate
+	// calls. Draws from the calling thread's UserRNG engine.
+	template<class BaseType, class SurrogateFn>
+	static int Refine(BaseType& io_base, const SurrogateFn& in_surrogateFn, const Settings& in_settings)
+	{
+		arma::mat& weights = io_base.Parameters();
+		arma::mat iterate = weights;
+		arma::mat direction(weights.n_rows, weights.n_cols);
+		arma::mat gradient(weights.n_rows, weights.n_cols);
+
+		mlpack::optimization::RMSPropUpdate update;
+		update.Initialize(weights.n_rows, weights.n_cols);
+
+		auto fiftyFn = UserRNG::GetRngFn(0.5);
+		const double c = in_settings.perturbation;
+
+		for (int step = 0; step < in_settings.numSteps; step++)
+		{
+			direction.for_each([&fiftyFn] (double& it) { it = fiftyFn() ? 1.0 : -1.0; });
+
+			// assign in place, mlpack layers alias the parameter memory
+			weights = iterate + c * direction;
+			const double fitnessPlus = in_surrogateFn(io_base);
+
+			weights = iterate - c * direction;
+			const double fitnessMinus = in_surrogateFn(io_base);
+
+			// RMSProp minimizes, so step along the negated ascent direction.
+			// 1 / direction_i == direction_i for +-1 entries.
+			gradient = ((fitnessMinus - fitnessPlus) / (2.0 * c)) * direction;
+
+			update.Update(iterate, in_settings.stepSize, gradient);
+			iterate.clamp(in_settings.minWeight, in_settings.maxWeight);
+		}
+
+		weights = iterate;
+		return 2 * in_settings.numSteps;
+	}
+};
+
+#endif
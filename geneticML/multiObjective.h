@@ -0,0 +1,430 @@
+#ifndef MULTIOBJECTIVE_H
+#define MULTIOBJECTIVE_H
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// A FitnessFn that returns std::array<double, M> instead of a double puts the
+// trainer in multi-objective mode. Every objective is maximized, so return
+// costs such as drawdown or turnover negated.
+template <size_t M>
+using Objectives = std::array<double, M>;
+
+template <class T>
+struct IsObjectiveVector : std::false_type {};
+
+template <size_t M>
+struct IsObjectiveVector<std::array<double, M>> : std::true_type {};
+
+inline std::string FormatFitness(double in_fitness)
+{
+	char buf[32];
+	snprintf(buf, 32, "%.3f", in_fitness);
+	return buf;
+}
+
+template <size_t M>
+std::string FormatFitness(const Objectives<M>& in_objectives)
+{
+	std::string ret;
+	for (auto& it : in_objectives)
+	{
+		ret += FormatFitness(it) + " ";
+	}
+	return ret;
+}
+
+// single value used where a scalar is needed (logging, plateau detection),
+// the first objective for objective vectors
+inline double PrimaryFitness(double in_fitness)
+{
+	return in_fitness;
+}
+
+template <size_t M>
+double PrimaryFitness(const Objectives<M>& in_objectives)
+{
+	return in_objectives[0];
+}
+
+// true when in_a is at least as good in every objective and better in one
+template <size_t M>
+bool Dominates(const Objectives<M>& in_a, const Objectives<M>& in_b)
+{
+	bool better = false;
+	for (size_t m = 0; m < M; m++)
+	{
+		if (in_a[m] < in_b[m])
+		{
+			return false;
+		}
+		better |= (in_a[m] > in_b[m]);
+	}
+	return better;
+}
+
+// Divide and conquer non-dominated sort for three or more objectives, the
+// generalized Jensen algorithm as corrected by Buzdalov and Shalyto:
+// O(N log^(M-1) N) instead of comparing every pair.
+//
+// Works on distinct objective vectors in descending lexicographic order, so
+// a vector can only be dominated by earlier ones. SortA() ranks a set whose
+// members are equal in the objectives after k. SortB() raises the ranks of
+// a set from the final ranks of another, whose members are at least as good
+// in the objectives after k. Both split at the median of objective k and
+// drop to k - 1 where the halves are ordered in it, down to a sweep over the
+// first two objectives.
+template <size_t M>
+class JensenSort
+{
+static_assert(M >= 2, "the sweep needs two objectives");
+
+using Set = std::vector<int>;
+
+public:
+	// in_points distinct and sorted in descending lexicographic order
+	explicit JensenSort(const std::vector<Objectives<M>>& in_points)
+	:points(in_points)
+	,ranks(in_points.size(), 0)
+	{
+		Set all(points.size());
+		std::iota(all.begin(), all.end(), 0);
+		SortA(all, M - 1);
+	}
+
+	const std::vector<int>& GetRanks() const { return ranks; }
+
+private:
+	const std::vector<Objectives<M>>& points;
+	std::vector<int> ranks;
+
+	// best rank per objective 1 value, for values at least as good as the
+	// query's. Ranks rise as the values fall, so the first key not below
+	// the query holds the answer.
+	using Staircase = std::map<double, int, std::greater<double>>;
+
+	static int Query(const Staircase& in_stairs, double in_value)
+	{
+		auto it = in_stairs.upper_bound(in_value);
+		return (it == in_stairs.begin()) ? -1 : std::prev(it)->second;
+	}
+
+	static void Add(Staircase& io_stairs, double in_value, int in_rank)
+	{
+		if (Query(io_stairs, in_value) >= in_rank)
+		{
+			return;
+		}
+
+		auto it = io_stairs.insert_or_assign(in_value, in_rank).first;
+		for (++it; (it != io_stairs.end()) && (it->second <= in_rank); )
+		{
+			it = io_stairs.erase(it);
+		}
+	}
+
+	// at least as good in the objectives up to in_k
+	bool WeaklyDominates(int in_a, int in_b, size_t in_k) const
+	{
+		for (size_t m = 0; m <= in_k; m++)
+		{
+			if (points[in_a][m] < points[in_b][m])
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	double Median(const Set& in_set, size_t in_k) const
+	{
+		std::vector<double> values(in_set.size());
+		for (size_t i = 0; i < in_set.size(); i++)
+		{
+			values[i] = points[in_set[i]][in_k];
+		}
+
+		auto middle = values.begin() + values.size() / 2;
+		std::nth_element(values.begin(), middle, values.end());
+		return *middle;
+	}
+
+	// splits by objective in_k into better than, equal to and worse than
+	// in_median, keeping the order
+	void Split(const Set& in_set, size_t in_k, double in_median,
+	           Set& out_better, Set& out_equal, Set& out_worse) const
+	{
+		for (int it : in_set)
+		{
+			const double value = points[it][in_k];
+			Set& target = (value > in_median) ? out_better : (value < in_median) ? out_worse : out_equal;
+			target.push_back(it);
+		}
+	}
+
+	static Set Merge(const Set& in_a, const Set& in_b)
+	{
+		Set merged;
+		merged.reserve(in_a.size() + in_b.size());
+		std::merge(in_a.begin(), in_a.end(), in_b.begin(), in_b.end(), std::back_inserter(merged));
+		return merged;
+	}
+
+	void SortA(const Set& in_set, size_t in_k)
+	{
+		if (in_set.size() < 2)
+		{
+			return;
+		}
+
+		if (in_k == 1)
+		{
+			Staircase stairs;
+			for (int it : in_set)
+			{
+				ranks[it] = std::max(ranks[it], Query(stairs, points[it][1]) + 1);
+				Add(stairs, points[it][1], ranks[it]);
+			}
+			return;
+		}
+
+		const double median = Median(in_set, in_k);
+		Set better, equal, worse;
+		Split(in_set, in_k, median, better, equal, worse);
+
+		if (equal.size() == in_set.size())
+		{
+			SortA(in_set, in_k - 1);
+			return;
+		}
+
+		SortA(better, in_k);
+		SortB(better, equal, in_k - 1);
+		SortA(equal, in_k - 1);
+		SortB(Merge(better, equal), worse, in_k - 1);
+		SortA(worse, in_k);
+	}
+
+	void SortB(const Set& in_from, const Set& in_to, size_t in_k)
+	{
+		if (in_from.empty() || in_to.empty())
+		{
+			return;
+		}
+
+		if ((in_from.size() == 1) || (in_to.size() == 1))
+		{
+			for (int to : in_to)
+			{
+				for (int from : in_from)
+				{
+					if ((from < to) && WeaklyDominates(from, to, in_k))
+					{
+						ranks[to] = std::max(ranks[to], ranks[from] + 1);
+					}
+				}
+			}
+			return;
+		}
+
+		if (in_k == 1)
+		{
+			Staircase stairs;
+			size_t next = 0;
+
+			for (int to : in_to)
+			{
+				for (; (next < in_from.size()) && (in_from[next] < to); next++)
+				{
+					Add(stairs, points[in_from[next]][1], ranks[in_from[next]]);
+				}
+				ranks[to] = std::max(ranks[to], Query(stairs, points[to][1]) + 1);
+			}
+			return;
+		}
+
+		auto byK = [this, in_k] (int a, int b) { return points[a][in_k] < points[b][in_k]; };
+		const double fromWorst = points[*std::min_element(in_from.begin(), in_from.end(), byK)][in_k];
+		const double fromBest = points[*std::max_element(in_from.begin(), in_from.end(), byK)][in_k];
+		const double toWorst = points[*std::min_element(in_to.begin(), in_to.end(), byK)][in_k];
+		const double toBest = points[*std::max_element(in_to.begin(), in_to.end(), byK)][in_k];
+
+		if (fromWorst >= toBest)
+		{
+			SortB(in_from, in_to, in_k - 1);
+			return;
+		}
+		if (fromBest < toWorst)
+		{
+			return;
+		}
+
+		const double median = Median(Merge(in_from, in_to), in_k);
+		Set fromBetter, fromEqual, fromWorse;
+		Set toBetter, toEqual, toWorse;
+		Split(in_from, in_k, median, fromBetter, fromEqual, fromWorse);
+		Split(in_to, in_k, median, toBetter, toEqual, toWorse);
+
+		SortB(fromBetter, toBetter, in_k);
+		SortB(fromBetter, toEqual, in_k - 1);
+		SortB(fromEqual, toEqual, in_k - 1);
+		SortB(Merge(fromBetter, fromEqual), toWorse, in_k - 1);
+		SortB(fromWorse, toWorse, in_k);
+	}
+};
+
+// returns the front of each solution, 0 being the non-dominated front.
+//
+// Solutions are visited in descending lexicographic order, so a solution can
+// only be dominated by ones already placed. With up to two objectives only
+// the last member of a front needs checking, and the front is found by
+// binary search over the existing ones (ENS-BS), O(N log N). More objectives
+// go through JensenSort, identical solutions share a front.
+template <size_t M>
+std::vector<int> NonDominatedSort(const std::vector<Objectives<M>>& in_objectives)
+{
+	const size_t num = in_objectives.size();
+
+	std::vector<size_t> order(num);
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&in_objectives] (size_t a, size_t b)
+	{
+		return in_objectives[a] > in_objectives[b];
+	});
+
+	std::vector<int> ranks(num, 0);
+
+	if constexpr (M > 2)
+	{
+		std::vector<Objectives<M>> distinct;
+		std::vector<int> distinctIndex(num);
+
+		for (size_t i = 0; i < num; i++)
+		{
+			if ((i == 0) || (in_objectives[order[i]] != distinct.back()))
+			{
+				distinct.push_back(in_objectives[order[i]]);
+			}
+			distinctIndex[order[i]] = (int) distinct.size() - 1;
+		}
+
+		JensenSort<M> sort(distinct);
+		for (size_t i = 0; i < num; i++)
+		{
+			ranks[i] = sort.GetRanks()[distinctIndex[i]];
+		}
+		return ranks;
+	}
+
+	std::vector<size_t> frontLast;
+
+	for (size_t index : order)
+	{
+		size_t low = 0;
+		size_t high = frontLast.size();
+
+		while (low < high)
+		{
+			size_t mid = (low + high) / 2;
+			if (Dominates(in_objectives[frontLast[mid]], in_objectives[index]))
+			{
+				low = mid + 1;
+			}
+			else
+			{
+				high = mid;
+			}
+		}
+
+		if (low == frontLast.size())
+		{
+			frontLast.emplace_back();
+		}
+
+		frontLast[low] = index;
+		ranks[index] = (int) low;
+	}
+
+	return ranks;
+}
+
+// NSGA-II crowding distance, computed within each front. Boundary solutions
+// get an infinite distance so they are always kept.
+template <size_t M>
+std::vector<double> CrowdingDistance(
+                const std::vector<Objectives<M>>& in_objectives,
+                const std::vector<int>& in_ranks )
+{
+	const size_t num = in_objectives.size();
+	const double inf = std::numeric_limits<double>::infinity();
+
+	std::vector<double> distance(num, 0.0);
+
+	int numFronts = in_ranks.empty() ? 0 : *std::max_element(in_ranks.begin(), in_ranks.end()) + 1;
+	std::vector<std::vector<size_t>> fronts(numFronts);
+	for (size_t i = 0; i < num; i++)
+	{
+		fronts[in_ranks[i]].push_back(i);
+	}
+
+	for (auto& front : fronts)
+	{
+		for (size_t m = 0; m < M; m++)
+		{
+			std::sort(front.begin(), front.end(), [&in_objectives, m] (size_t a, size_t b)
+			{
+				return in_objectives[a][m] < in_objectives[b][m];
+			});
+
+			const double range = in_objectives[front.back()][m] - in_objectives[front.front()][m];
+
+			distance[front.front()] = inf;
+			distance[front.back()] = inf;
+
+			if (range <= 0.0)
+			{
+				continue;
+			}
+
+			for (size_t i = 1; i + 1 < front.size(); i++)
+			{
+				distance[front[i]] +=
+					(in_objectives[front[i+1]][m] - in_objectives[front[i-1]][m]) / range;
+			}
+		}
+	}
+
+	return distance;
+}
+
+// best first ordering: lower front, then larger crowding distance
+template <size_t M>
+std::vector<size_t> RankByDominance(const std::vector<Objectives<M>>& in_objectives)
+{
+	const std::vector<int> ranks = NonDominatedSort(in_objectives);
+	const std::vector<double> distance = CrowdingDistance(in_objectives, ranks);
+
+	std::vector<size_t> order(in_objectives.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&ranks, &distance] (size_t a, size_t b)
+	{
+		if (ranks[a] != ranks[b])
+		{
+			return ranks[a] < ranks[b];
+		}
+		return distance[a] > distance[b];
+	});
+
+	return order;
+}
+
+#endif
@@ -1,11 +1,17 @@
 #ifndef ORGANISM_H 
 #define ORGANISM_H  
 
+#include <array>
+#include <atomic>
+#include <bitset>
 #include <iostream>
+#include <memory_resource>
 #include <unordered_set>
 
 #include "util.h"
+#include "genome.h"
 #include "userRNG.h"
+#include "multiObjective.h"
 
 class OrganismSettings
 {
@@ -16,18 +22,65 @@ class OrganismSettings
 	std::variant<int, double> maxWeight;
 };
 
-template <class BaseType, typename MutationDistribution, typename WeightDistribution>
+// deleter for organisms built in a block the caller frees, see
+// GeneticAlgoTrainer
+template <class T>
+struct DestroyOnly
+{
+	void operator()(T* in_ptr) const { in_ptr->~T(); }
+};
+
+template <class BaseType, typename MutationDistribution, typename WeightDistribution, typename FitnessType = double>
 class Organism
 {
-using ThisType = Organism<BaseType, MutationDistribution, WeightDistribution>;
+using ThisType = Organism<BaseType, MutationDistribution, WeightDistribution, FitnessType>;
 using pBaseType = std::unique_ptr<BaseType>;
 
+using ParamsType =
+    typename std::decay<
+        decltype(std::declval<BaseType&>().Parameters())>::type;
+
 public:
 	enum class EvolveType {Random=0, CloneMutation, Child, ChildMutation};
 
-    pBaseType& GetBase(){return pBase;}
-    double GetFitness() const {return fitness;}
-    void SetFitness(double in_fitness) {fitness = in_fitness;}
+	// fixed size genomes are held by value, so a population built in one
+	// block keeps them all contiguous
+	static constexpr bool IsFixed = IsFixedGenome<ParamsType>::value;
+
+    BaseType* GetBase(){return &Base(this);}
+
+    // the best organism outlives the population, fixed size ones are copied
+    pBaseType ReleaseBase()
+    {
+        if constexpr (IsFixed)
+        {
+            return std::make_unique<BaseType>(base);
+        }
+        else
+        {
+            return std::move(base);
+        }
+    }
+
+    const FitnessType& GetFitness() const {return fitness;}
+    void SetFitness(const FitnessType& in_fitness) {fitness = in_fitness;}
+    void SetNicheCount(int in_nicheCount) {nicheCount = in_nicheCount;}
+    long long GetID() const {return ID;}
+    static long long NextID() {return OrganismIndexID++;}
+
+    // fitness shared with the other organisms of its niche, so crowded
+    // niches rank lower. Objective vectors rely on crowding distance instead.
+    FitnessType GetSharedFitness() const
+    {
+        if constexpr (std::is_arithmetic<FitnessType>::value)
+        {
+            return (fitness >= 0) ? fitness / nicheCount : fitness * nicheCount;
+        }
+        else
+        {
+            return fitness;
+        }
+    }
     
 	Organism() = delete;
 	Organism(const ThisType& rhs) = delete;
@@ -37,22 +90,28 @@ public:
 
 	// setup empty recurrent neural net with the in_createFn() call
 	Organism(pBaseType&& in_basePtr, MutationDistribution& in_mutationFn, WeightDistribution& in_weightFn)
-    :pBase(std::forward<pBaseType>(in_basePtr))
+    :base(TakeBase(std::forward<pBaseType>(in_basePtr)))
 	,mutationDistribution(in_mutationFn)
 	,weightDistribution(in_weightFn)
-	,fitness(0.0)
+	,fitness()
+	,nicheCount(1)
 	,ID(OrganismIndexID++)
 	{
 		RandomizeWeights();
-		Log("created org, ", pBase->Parameters());
+		Log("created org, ", FormatGenome(Base(this).Parameters()));
 	}
 
+	// IDs are handed out by the caller with NextID(), so they can be drawn in
+	// a fixed order even when organisms evolve on worker threads. Temporaries
+	// come from in_memory, usually the worker's EpochArena.
 	void Evolve(
                 const ThisType* parentA,
                 const ThisType* parentB,
-                EvolveType in_evolveType )
+                EvolveType in_evolveType,
+                long long in_ID,
+                std::pmr::memory_resource* in_memory = std::pmr::get_default_resource() )
 	{
-		ID = OrganismIndexID++;
+		ID = in_ID;
 
 		if (in_evolveType == EvolveType::Random)
 		{
@@ -60,7 +119,7 @@ public:
 		}
 		else if (in_evolveType == EvolveType::CloneMutation)
 		{
-			EvolveCloneWithMutation(parentA, mutationDistribution());
+			EvolveCloneWithMutation(parentA, mutationDistribution(), in_memory);
 		}
 		else if (in_evolveType == EvolveType::Child)
 		{
@@ -68,15 +127,15 @@ public:
 		}
 		else if (in_evolveType == EvolveType::ChildMutation)
 		{
-			EvolveChildFromParentsWithMutation(parentA, parentB, mutationDistribution());
+			EvolveChildFromParentsWithMutation(parentA, parentB, mutationDistribution(), in_memory);
 		}
 	}
 
 	void Display()
 	{ 
 		char buf[100];
-		snprintf(buf, 100, "%lld:\t%.3f\t", ID, fitness);
-		Log(buf);
+		snprintf(buf, 100, "%lld:\t", ID);
+		Log(buf, FormatFitness(fitness), "\t");
 	}
 
 	template<typename... Args>
@@ -84,102 +143,190 @@ public:
 	{
 		Display();
 		((args->Display()), ...);
-		auto& weights = pBase->Parameters();
+		auto& weights = Base(this).Parameters();
 		//for(int i = 0; i < weights.size(); i++)
 		{
-			Log(weights);
+			Log(FormatGenome(weights));
 			//printf("\n%d", weights[i]);
 			//((printf("\t%.6f", args->pBase->Parameters()[i]) ), ...);
 		}
 	}
 
 private:
-	pBaseType pBase;
+	typename std::conditional<IsFixed, BaseType, pBaseType>::type base;
 	MutationDistribution& mutationDistribution;
 	WeightDistribution& weightDistribution;
-	double fitness;
+	FitnessType fitness;
+	int nicheCount;
 	long long ID;
 
-	static long long OrganismIndexID;
+	static std::atomic<long long> OrganismIndexID;
+
+	static auto TakeBase(pBaseType&& in_basePtr)
+	{
+		if constexpr (IsFixed)
+		{
+			return BaseType(std::move(*in_basePtr));
+		}
+		else
+		{
+			return std::move(in_basePtr);
+		}
+	}
+
+	// Parameters() is not const on the bases, parents are only read
+	static BaseType& Base(const ThisType* in_organism)
+	{
+		if constexpr (IsFixed)
+		{
+			return const_cast<BaseType&>(in_organism->base);
+		}
+		else
+		{
+			return *in_organism->base;
+		}
+	}
 
 	// set all the child weights from one parent or the other (randomly chosen)
 	void EvolveChildFromParents(
                           const ThisType* parentA,
                           const ThisType* parentB )
 	{
-		auto& childWeights = pBase->Parameters();
-		auto& parentAWeights = parentA->pBase->Parameters();
-		auto& parentBWeights = parentB->pBase->Parameters();
+		auto& childWeights = Base(this).Parameters();
+		auto& parentAWeights = Base(parentA).Parameters();
+		auto& parentBWeights = Base(parentB).Parameters();
 
-		if ((childWeights.size() != parentAWeights.size()) ||
-            (childWeights.size() != parentBWeights.size())    )
+		if constexpr (IsFixed)
 		{
-			ReportFatalError("error, weights not same");
+			EvolveFixedChildFromParents(childWeights, parentAWeights, parentBWeights);
 		}
-
-		auto fiftyFn = UserRNG::GetRngFn(0.5);
-
-		for (int i = 0; i < childWeights.size(); i++)
+		else
 		{
-			// 50/50 chance to get each weight from either parent
-			if (fiftyFn())
+			if ((childWeights.size() != parentAWeights.size()) ||
+	            (childWeights.size() != parentBWeights.size())    )
 			{
-				childWeights[i] = parentAWeights[i];
+				ReportFatalError("error, weights not same");
 			}
-			else
+
+			auto fiftyFn = UserRNG::GetRngFn(0.5);
+
+			for (int i = 0; i < childWeights.size(); i++)
 			{
-				childWeights[i] = parentBWeights[i];
+				// 50/50 chance to get each weight from either parent
+				if (fiftyFn())
+				{
+					childWeights[i] = parentAWeights[i];
+				}
+				else
+				{
+					childWeights[i] = parentBWeights[i];
+				}
 			}
 		}
 	}
 
+	// one random bit per weight, drawn 64 at a time, then a branch free
+	// select over a compile time count
+	static void EvolveFixedChildFromParents(
+                          ParamsType& out_childWeights,
+                          const ParamsType& in_parentAWeights,
+                          const ParamsType& in_parentBWeights )
+	{
+		constexpr size_t N = FixedGenomeSize<ParamsType>::value;
+
+		std::array<uint64_t, (N + 63) / 64> masks;
+		std::uniform_int_distribution<uint64_t> bitsDist;
+		for (auto& it : masks)
+		{
+			it = bitsDist(UserRNG::GetEngine());
+		}
+
+		for (size_t i = 0; i < N; i++)
+		{
+			const bool fromA = (masks[i / 64] >> (i % 64)) & 1;
+			out_childWeights[i] = fromA ? in_parentAWeights[i] : in_parentBWeights[i];
+		}
+	}
+
 	void EvolveCloneWithMutation(
                         const ThisType* parentA,
-                        double in_mutProb )
+                        double in_mutProb,
+                        std::pmr::memory_resource* in_memory )
 	{
-		pBase->Parameters() = parentA->pBase->Parameters();
-		Mutate(in_mutProb);
+		Base(this).Parameters() = Base(parentA).Parameters();
+		Mutate(in_mutProb, in_memory);
 	}
 
 	void EvolveChildFromParentsWithMutation(
                                       const ThisType* parentA,
                                       const ThisType* parentB,
-                                      double in_mutProb )
+                                      double in_mutProb,
+                                      std::pmr::memory_resource* in_memory )
 	{
 		EvolveChildFromParents(parentA, parentB);
-		Mutate(in_mutProb);
+		Mutate(in_mutProb, in_memory);
 	}
 
 	// randomize all the weights of all the parameters
 	void RandomizeWeights()
 	{
-		for (auto& it : pBase->Parameters())
+		for (auto& it : Base(this).Parameters())
 		{
 			it = weightDistribution();
 		}
 	}
 
-	void Mutate(double mutationPercentage)
+	void Mutate(double mutationPercentage, std::pmr::memory_resource* in_memory)
 	{
-		std::unordered_set<int> mutationIndexes;
-		auto& weights = pBase->Parameters();
-
-		int numMutations = (double)mutationPercentage * weights.size();
-		auto mutationIndexDist = UserRNG::GetRngFn(0, (int) weights.size()-1);
+		auto& weights = Base(this).Parameters();
 
-		while (mutationIndexes.size() != numMutations)
+		if constexpr (IsFixed)
 		{
-			mutationIndexes.insert(mutationIndexDist());
+			MutateFixed(weights, mutationPercentage);
+		}
+		else
+		{
+			int numMutations = (double)mutationPercentage * weights.size();
+
+			std::pmr::unordered_set<int> mutationIndexes(in_memory);
+			mutationIndexes.reserve(numMutations);
+			auto mutationIndexDist = UserRNG::GetRngFn(0, (int) weights.size()-1);
+
+			while (mutationIndexes.size() != numMutations)
+			{
+				mutationIndexes.insert(mutationIndexDist());
+			}
+
+			std::for_each(
+				mutationIndexes.begin(), 
+				mutationIndexes.end(),
+				[&weights, this](int index){ weights[index] = weightDistribution(); } );
 		}
+	}
+
+	// distinct indexes tracked in a bitset on the stack instead of a set
+	void MutateFixed(ParamsType& io_weights, double mutationPercentage)
+	{
+		constexpr size_t N = FixedGenomeSize<ParamsType>::value;
 
-		std::for_each(
-			mutationIndexes.begin(), 
-			mutationIndexes.end(),
-			[&weights, this](int index){ weights[index] = weightDistribution(); } );
+		const size_t numMutations = std::min<size_t>(mutationPercentage * N, N);
+
+		std::bitset<N> mutated;
+		std::uniform_int_distribution<size_t> mutationIndexDist(0, N - 1);
+
+		while (mutated.count() != numMutations)
+		{
+			const size_t index = mutationIndexDist(UserRNG::GetEngine());
+			if (!mutated[index])
+			{
+				mutated[index] = true;
+				io_weights[index] = weightDistribution();
+			}
+		}
 	}
 };
 
-template <class BaseType, typename MutationDistribution, typename WeightDistribution>
-long long Organism<BaseType, MutationDistribution, WeightDistribution>::OrganismIndexID = 0;
+template <class BaseType, typename MutationDistribution, typename WeightDistribution, typename FitnessType>
+std::atomic<long long> Organism<BaseType, MutationDistribution, WeightDistribution, FitnessType>::OrganismIndexID(0);
 
 #endif
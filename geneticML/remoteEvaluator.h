@@ -0,0 +1,799 @@
+#ifndef REMOTEEVALUATOR_H
+#define REMOTEEVALUATOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#include <mach-o/dyld.h>
+#endif
+
+#include "util.h"
+#include "genome.h"
+
+extern char** environ;
+
+// Layout of the shared memory segment between a RemoteEvaluatorPool and its
+// evaluator processes:
+//  - numSlots request slots, each a state word, the fitness and the genome
+//    as doubles. Evaluators score the genome in place.
+//  - a request ring of slot indices. The pool publishes by advancing
+//    submitHead, evaluators claim up to batchSize entries at a time by
+//    advancing claimTail with a CAS.
+//  - one completion queue of slot indices per evaluator, single producer
+//    single consumer.
+// A slot is in the ring at most once, so numSlots entries never overflow.
+class RemoteEvaluatorSegment
+{
+public:
+	static constexpr uint32_t Magic = 0x67614d4c;
+
+	enum SlotState : uint32_t {Free=0, Ready, Claimed, Done};
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t numSlots;
+		uint32_t numWorkers;
+		uint32_t batchSize;
+		uint64_t genomeSize;
+		pid_t parentPid;
+		std::atomic<uint32_t> shutdown;
+
+		alignas(64) std::atomic<uint64_t> submitHead;
+		alignas(64) std::atomic<uint64_t> claimTail;
+	};
+
+	struct Slot
+	{
+		std::atomic<uint32_t> state;
+		uint32_t worker;
+
+		// steady clock nanoseconds when the evaluation started, 0 before
+		std::atomic<int64_t> startTime;
+		double fitness;
+
+		double* Genome() { return reinterpret_cast<double*>(this + 1); }
+	};
+
+	struct CompletionQueue
+	{
+		alignas(64) std::atomic<uint64_t> head;
+		alignas(64) std::atomic<uint64_t> tail;
+
+		uint32_t* Entries() { return reinterpret_cast<uint32_t*>(this + 1); }
+	};
+
+	static_assert(std::atomic<uint32_t>::is_always_lock_free &&
+	              std::atomic<uint64_t>::is_always_lock_free &&
+	              std::atomic<int64_t>::is_always_lock_free,
+	              "atomics shared between processes must be lock free");
+
+	static size_t SizeOf(uint32_t in_numSlots, uint32_t in_numWorkers, uint64_t in_genomeSize)
+	{
+		return Offsets(in_numSlots, in_numWorkers, in_genomeSize).total;
+	}
+
+	// constructs the header, queues and slots in freshly mapped memory
+	static void Initialize(void* io_memory, uint32_t in_numSlots, uint32_t in_numWorkers,
+	                       uint32_t in_batchSize, uint64_t in_genomeSize)
+	{
+		Header* header = new (io_memory) Header();
+		header->magic = Magic;
+		header->numSlots = in_numSlots;
+		header->numWorkers = in_numWorkers;
+		header->batchSize = in_batchSize;
+		header->genomeSize = in_genomeSize;
+		header->parentPid = getpid();
+		header->shutdown = 0;
+		header->submitHead = 0;
+		header->claimTail = 0;
+
+		RemoteEvaluatorSegment segment(io_memory);
+		for (uint32_t i = 0; i < in_numWorkers; i++)
+		{
+			new (segment.GetQueue(i)) CompletionQueue();
+			segment.GetQueue(i)->head = 0;
+			segment.GetQueue(i)->tail = 0;
+		}
+		for (uint32_t i = 0; i < in_numSlots; i++)
+		{
+			new (segment.GetSlot(i)) Slot();
+			segment.GetSlot(i)->state = Free;
+			segment.GetSlot(i)->startTime = 0;
+		}
+	}
+
+	// view of an initialized segment
+	explicit RemoteEvaluatorSegment(void* in_memory)
+	:base(static_cast<char*>(in_memory))
+	,header(static_cast<Header*>(in_memory))
+	,offsets(Offsets(header->numSlots, header->numWorkers, header->genomeSize))
+	{
+	}
+
+	Header* GetHeader() const { return header; }
+	uint32_t* GetRing() const { return reinterpret_cast<uint32_t*>(base + offsets.ring); }
+
+	CompletionQueue* GetQueue(uint32_t in_worker) const
+	{
+		return reinterpret_cast<CompletionQueue*>(base + offsets.queues + in_worker * offsets.queueStride);
+	}
+
+	Slot* GetSlot(uint32_t in_slot) const
+	{
+		return reinterpret_cast<Slot*>(base + offsets.slots + in_slot * offsets.slotStride);
+	}
+
+	static int64_t Now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch() ).count();
+	}
+
+private:
+	struct Layout
+	{
+		size_t ring;
+		size_t queues;
+		size_t queueStride;
+		size_t slots;
+		size_t slotStride;
+		size_t total;
+	};
+
+	// everything starts on its own cache line
+	static size_t Align(size_t in_size) { return (in_size + 63) & ~size_t(63); }
+
+	static Layout Offsets(uint32_t in_numSlots, uint32_t in_numWorkers, uint64_t in_genomeSize)
+	{
+		Layout layout;
+		layout.ring = Align(sizeof(Header));
+		layout.queues = layout.ring + Align(in_numSlots * sizeof(uint32_t));
+		layout.queueStride = Align(sizeof(CompletionQueue) + in_numSlots * sizeof(uint32_t));
+		layout.slots = layout.queues + in_numWorkers * layout.queueStride;
+		layout.slotStride = Align(sizeof(Slot) + in_genomeSize * sizeof(double));
+		layout.total = layout.slots + in_numSlots * layout.slotStride;
+		return layout;
+	}
+
+	char* base;
+	Header* header;
+	Layout offsets;
+};
+
+// Scores genomes in separate evaluator processes, so a crashing simulator
+// costs a restart instead of the whole run.
+//
+// Each evaluator is started as "command --evaluator <segment> <index>" and
+// runs RemoteEvaluatorWorker::Serve(). A collector thread resolves the
+// futures from the completion queues, restarts evaluators that exit or
+// spend more than timeoutSeconds on one genome, and resubmits their genomes
+// up to maxRetries times before failing them with failureFitness.
+class RemoteEvaluatorPool
+{
+public:
+	struct Settings
+	{
+		// looked up in PATH when it has no slash, empty runs this
+		// executable again
+		std::string command;
+		int numWorkers = 4;
+		int numSlots = 256;
+
+		// requests an evaluator claims at once
+		int batchSize = 8;
+
+		double timeoutSeconds = 60.0;
+		int maxRetries = 2;
+		double failureFitness = -std::numeric_limits<double>::infinity();
+	};
+
+	RemoteEvaluatorPool(size_t in_genomeSize, const Settings& in_settings)
+	:genomeSize(in_genomeSize)
+	,settings(in_settings)
+	,segmentName("/geneticML." + std::to_string(getpid()) + "." + std::to_string(NextPoolID()))
+	,memory(nullptr)
+	,memorySize(RemoteEvaluatorSegment::SizeOf(in_settings.numSlots, in_settings.numWorkers, in_genomeSize))
+	,requests(in_settings.numSlots)
+	,workerPids(in_settings.numWorkers, -1)
+	,stopping(false)
+	,numRestarts(0)
+	,numTimeouts(0)
+	,numFailures(0)
+	{
+		if (settings.command.empty())
+		{
+			settings.command = CurrentExecutable();
+		}
+
+		const int fd = shm_open(segmentName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (fd < 0)
+		{
+			ReportFatalError("error: could not create shared memory segment: "s + segmentName);
+		}
+
+		if (ftruncate(fd, memorySize) != 0)
+		{
+			close(fd);
+			shm_unlink(segmentName.c_str());
+			ReportFatalError("error: could not size shared memory segment: "s + segmentName);
+		}
+
+		memory = mmap(nullptr, memorySize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+
+		if (memory == MAP_FAILED)
+		{
+			shm_unlink(segmentName.c_str());
+			ReportFatalError("error: could not map shared memory segment: "s + segmentName);
+		}
+
+		RemoteEvaluatorSegment::Initialize(
+			memory, settings.numSlots, settings.numWorkers, settings.batchSize, genomeSize);
+		segment = std::make_unique<RemoteEvaluatorSegment>(memory);
+
+		for (int i = settings.numSlots - 1; i >= 0; i--)
+		{
+			freeSlots.push_back(i);
+		}
+
+		for (int i = 0; i < settings.numWorkers; i++)
+		{
+			Spawn(i);
+		}
+
+		collector = std::thread([this] () { Collect(); });
+	}
+
+	~RemoteEvaluatorPool()
+	{
+		// the collector would restart evaluators as they shut down
+		stopping = true;
+		collector.join();
+		segment->GetHeader()->shutdown.store(1, std::memory_order_release);
+
+		for (pid_t pid : workerPids)
+		{
+			StopWorker(pid, std::chrono::seconds(1));
+		}
+
+		// nobody is left to answer, don't leave futures waiting forever
+		for (auto& it : requests)
+		{
+			if (it.inFlight)
+			{
+				it.inFlight = false;
+				it.promise.set_value(settings.failureFitness);
+			}
+		}
+
+		munmap(memory, memorySize);
+		shm_unlink(segmentName.c_str());
+	}
+
+	RemoteEvaluatorPool(const RemoteEvaluatorPool&) = delete;
+	RemoteEvaluatorPool& operator=(const RemoteEvaluatorPool&) = delete;
+
+	// copies the genome into a free slot, blocks while all slots are busy.
+	// Safe to call from any thread.
+	template<class Params>
+	std::future<double> Submit(const Params& in_params)
+	{
+		if (GenomeSize(in_params) != genomeSize)
+		{
+			ReportFatalError("error: genome size does not match the remote evaluator pool");
+		}
+
+		const auto* weights = GenomeData(in_params);
+		const uint32_t slot = AcquireSlots(1).front();
+
+		std::copy(weights, weights + genomeSize, segment->GetSlot(slot)->Genome());
+		std::future<double> result = requests.at(slot).promise.get_future();
+
+		Publish(&slot, 1);
+		return result;
+	}
+
+	// one request per column, published a batch of slots at a time
+	std::vector<std::future<double>> SubmitBatch(const arma::mat& in_genomes)
+	{
+		if (in_genomes.n_rows != genomeSize)
+		{
+			ReportFatalError("error: genome size does not match the remote evaluator pool");
+		}
+
+		std::vector<std::future<double>> results;
+		results.reserve(in_genomes.n_cols);
+
+		while (results.size() < in_genomes.n_cols)
+		{
+			const std::vector<uint32_t> slots = AcquireSlots(in_genomes.n_cols - results.size());
+
+			for (uint32_t slot : slots)
+			{
+				const double* column = in_genomes.colptr(results.size());
+				std::copy(column, column + genomeSize, segment->GetSlot(slot)->Genome());
+				results.emplace_back(requests.at(slot).promise.get_future());
+			}
+
+			Publish(slots.data(), slots.size());
+		}
+
+		return results;
+	}
+
+	long long GetNumRestarts() const { return numRestarts; }
+	long long GetNumTimeouts() const { return numTimeouts; }
+	long long GetNumFailures() const { return numFailures; }
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct Request
+	{
+		std::promise<double> promise;
+		int retries = 0;
+		uint64_t sequence = 0;
+		Clock::time_point published;
+		bool inFlight = false;
+	};
+
+	static int NextPoolID()
+	{
+		static std::atomic<int> poolID(0);
+		return poolID++;
+	}
+
+	// at least one and at most in_count slots
+	std::vector<uint32_t> AcquireSlots(size_t in_count)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		slotFreed.wait(lock, [this] () { return !freeSlots.empty(); });
+
+		std::vector<uint32_t> slots;
+		while (!freeSlots.empty() && (slots.size() < in_count))
+		{
+			const uint32_t slot = freeSlots.back();
+			freeSlots.pop_back();
+
+			requests.at(slot).promise = std::promise<double>();
+			requests.at(slot).retries = 0;
+			slots.push_back(slot);
+		}
+		return slots;
+	}
+
+	void Publish(const uint32_t* in_slots, size_t in_count)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		PublishLocked(in_slots, in_count);
+	}
+
+	// ring entries and slot states are plain writes, the release store of
+	// submitHead makes them visible to the evaluators
+	void PublishLocked(const uint32_t* in_slots, size_t in_count)
+	{
+		auto* header = segment->GetHeader();
+		uint64_t head = header->submitHead.load(std::memory_order_relaxed);
+
+		for (size_t i = 0; i < in_count; i++)
+		{
+			const uint32_t slot = in_slots[i];
+
+			Request& request = requests.at(slot);
+			request.sequence = head;
+			request.published = Clock::now();
+			request.inFlight = true;
+
+			segment->GetSlot(slot)->startTime.store(0, std::memory_order_relaxed);
+			segment->GetSlot(slot)->state.store(RemoteEvaluatorSegment::Ready, std::memory_order_relaxed);
+
+			segment->GetRing()[head % settings.numSlots] = slot;
+			head++;
+		}
+
+		header->submitHead.store(head, std::memory_order_release);
+	}
+
+	void Collect()
+	{
+		auto lastCheck = Clock::now();
+
+		while (!stopping)
+		{
+			bool progress = false;
+			for (int i = 0; i < settings.numWorkers; i++)
+			{
+				progress |= DrainCompletions(i);
+			}
+
+			if (Clock::now() - lastCheck > std::chrono::milliseconds(10))
+			{
+				CheckWorkers();
+				lastCheck = Clock::now();
+			}
+
+			if (!progress)
+			{
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+			}
+		}
+	}
+
+	bool DrainCompletions(int in_worker)
+	{
+		auto* queue = segment->GetQueue(in_worker);
+		uint64_t tail = queue->tail.load(std::memory_order_relaxed);
+		const uint64_t head = queue->head.load(std::memory_order_acquire);
+
+		if (tail == head)
+		{
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		for (; tail < head; tail++)
+		{
+			const uint32_t slot = queue->Entries()[tail % settings.numSlots];
+			CompleteLocked(slot, segment->GetSlot(slot)->fitness);
+		}
+		queue->tail.store(tail, std::memory_order_release);
+		return true;
+	}
+
+	void CompleteLocked(uint32_t in_slot, double in_fitness)
+	{
+		Request& request = requests.at(in_slot);
+		if (!request.inFlight)
+		{
+			return;
+		}
+
+		request.inFlight = false;
+		request.promise.set_value(in_fitness);
+
+		segment->GetSlot(in_slot)->state.store(RemoteEvaluatorSegment::Free, std::memory_order_relaxed);
+		freeSlots.push_back(in_slot);
+		slotFreed.notify_one();
+	}
+
+	// resubmits a request whose evaluator went away, or fails it. Only
+	// attempts that started count, the rest of a claimed batch is innocent.
+	void RetryLocked(uint32_t in_slot, bool in_started)
+	{
+		Request& request = requests.at(in_slot);
+
+		if (in_started && (++request.retries > settings.maxRetries))
+		{
+			numFailures++;
+			Log( "remote evaluation failed after ", settings.maxRetries, " retries");
+			CompleteLocked(in_slot, settings.failureFitness);
+			return;
+		}
+
+		PublishLocked(&in_slot, 1);
+	}
+
+	void CheckWorkers()
+	{
+		const int64_t now = RemoteEvaluatorSegment::Now();
+		const int64_t timeout = settings.timeoutSeconds * 1e9;
+
+		for (int i = 0; i < settings.numWorkers; i++)
+		{
+			int status;
+			const bool exited = (waitpid(workerPids.at(i), &status, WNOHANG) == workerPids.at(i));
+
+			if (exited)
+			{
+				Log( "remote evaluator ", i, " exited, restarting it");
+				Restart(i);
+			}
+			else if (TimedOut(i, now, timeout))
+			{
+				numTimeouts++;
+				Log( "remote evaluator ", i, " timed out, restarting it");
+
+				kill(workerPids.at(i), SIGKILL);
+				waitpid(workerPids.at(i), &status, 0);
+				Restart(i);
+			}
+		}
+
+		// claimed by an evaluator that died before it could mark them
+		const uint64_t claimTail = segment->GetHeader()->claimTail.load(std::memory_order_acquire);
+		const auto lostAfter = Clock::now() - std::chrono::duration<double>(settings.timeoutSeconds);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		for (uint32_t slot = 0; slot < (uint32_t) settings.numSlots; slot++)
+		{
+			const Request& request = requests.at(slot);
+			if (request.inFlight &&
+			    (request.sequence < claimTail) &&
+			    (request.published < lostAfter) &&
+			    (segment->GetSlot(slot)->state.load(std::memory_order_acquire) == RemoteEvaluatorSegment::Ready) )
+			{
+				RetryLocked(slot, false);
+			}
+		}
+	}
+
+	bool TimedOut(int in_worker, int64_t in_now, int64_t in_timeout)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (uint32_t slot = 0; slot < (uint32_t) settings.numSlots; slot++)
+		{
+			auto* sharedSlot = segment->GetSlot(slot);
+			if (requests.at(slot).inFlight &&
+			    (sharedSlot->state.load(std::memory_order_acquire) == RemoteEvaluatorSegment::Claimed) &&
+			    (sharedSlot->worker == (uint32_t) in_worker) )
+			{
+				const int64_t startTime = sharedSlot->startTime.load(std::memory_order_relaxed);
+				if ((startTime != 0) && (in_now - startTime > in_timeout))
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	// in_worker has exited, settle what it held and start a new one
+	void Restart(int in_worker)
+	{
+		numRestarts++;
+		DrainCompletions(in_worker);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (uint32_t slot = 0; slot < (uint32_t) settings.numSlots; slot++)
+			{
+				auto* sharedSlot = segment->GetSlot(slot);
+				const uint32_t state = sharedSlot->state.load(std::memory_order_acquire);
+
+				if (!requests.at(slot).inFlight || (sharedSlot->worker != (uint32_t) in_worker))
+				{
+					continue;
+				}
+
+				// finished but not queued yet
+				if (state == RemoteEvaluatorSegment::Done)
+				{
+					CompleteLocked(slot, sharedSlot->fitness);
+				}
+				else if (state == RemoteEvaluatorSegment::Claimed)
+				{
+					RetryLocked(slot, sharedSlot->startTime.load(std::memory_order_relaxed) != 0);
+				}
+			}
+		}
+
+		auto* queue = segment->GetQueue(in_worker);
+		queue->head = 0;
+		queue->tail = 0;
+
+		Spawn(in_worker);
+	}
+
+	// argv[0] can be a bare name found through PATH or relative to a
+	// directory the process has left since, ask the system instead
+	static std::string CurrentExecutable()
+	{
+#if defined(__APPLE__)
+		uint32_t size = 0;
+		_NSGetExecutablePath(nullptr, &size);
+
+		std::string path(size, '\0');
+		if (_NSGetExecutablePath(&path[0], &size) != 0)
+		{
+			ReportFatalError("error: could not find the path of this executable");
+		}
+		path.resize(strlen(path.c_str()));
+		return path;
+#else
+		std::error_code error;
+		const std::filesystem::path path = std::filesystem::read_symlink("/proc/self/exe", error);
+		if (error)
+		{
+			ReportFatalError("error: could not find the path of this executable");
+		}
+		return path.string();
+#endif
+	}
+
+	void Spawn(int in_worker)
+	{
+		const std::string index = std::to_string(in_worker);
+		std::string evaluatorFlag = "--evaluator";
+
+		char* argv[] = {
+			const_cast<char*>(settings.command.c_str()),
+			const_cast<char*>(evaluatorFlag.c_str()),
+			const_cast<char*>(segmentName.c_str()),
+			const_cast<char*>(index.c_str()),
+			nullptr };
+
+		pid_t pid;
+		if (posix_spawnp(&pid, settings.command.c_str(), nullptr, nullptr, argv, environ) != 0)
+		{
+			ReportFatalError("error: could not start remote evaluator: "s + settings.command);
+		}
+
+		workerPids.at(in_worker) = pid;
+	}
+
+	static void StopWorker(pid_t in_pid, Clock::duration in_grace)
+	{
+		const auto deadline = Clock::now() + in_grace;
+		int status;
+
+		while (waitpid(in_pid, &status, WNOHANG) == 0)
+		{
+			if (Clock::now() > deadline)
+			{
+				kill(in_pid, SIGKILL);
+				waitpid(in_pid, &status, 0);
+				return;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	size_t genomeSize;
+	Settings settings;
+	std::string segmentName;
+	void* memory;
+	size_t memorySize;
+	std::unique_ptr<RemoteEvaluatorSegment> segment;
+
+	// guards freeSlots, requests and publishing
+	std::mutex mutex;
+	std::condition_variable slotFreed;
+	std::vector<uint32_t> freeSlots;
+	std::vector<Request> requests;
+
+	std::vector<pid_t> workerPids;
+	std::thread collector;
+	std::atomic<bool> stopping;
+
+	std::atomic<long long> numRestarts;
+	std::atomic<long long> numTimeouts;
+	std::atomic<long long> numFailures;
+};
+
+// Evaluator process side of RemoteEvaluatorPool.
+class RemoteEvaluatorWorker
+{
+public:
+	// scores the genome in place, it points into shared memory
+	using EvaluateFn = std::function<double(const double* in_genome, size_t in_size)>;
+
+	// evaluator main loop, returns the process exit code once the pool shuts
+	// down or the trainer process is gone
+	static int Serve(const std::string& in_segmentName, int in_worker, const EvaluateFn& in_evaluateFn)
+	{
+		const int fd = shm_open(in_segmentName.c_str(), O_RDWR, 0);
+		if (fd < 0)
+		{
+			Log( "error: could not open shared memory segment: ", in_segmentName);
+			return 1;
+		}
+
+		struct stat info;
+		if (fstat(fd, &info) != 0)
+		{
+			close(fd);
+			return 1;
+		}
+
+		void* memory = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+
+		if (memory == MAP_FAILED)
+		{
+			Log( "error: could not map shared memory segment: ", in_segmentName);
+			return 1;
+		}
+
+		const RemoteEvaluatorSegment segment(memory);
+		auto* header = segment.GetHeader();
+
+		if ((header->magic != RemoteEvaluatorSegment::Magic) ||
+		    (in_worker < 0) || ((uint32_t) in_worker >= header->numWorkers) )
+		{
+			munmap(memory, info.st_size);
+			Log( "error: bad remote evaluator segment or index");
+			return 1;
+		}
+
+		auto* queue = segment.GetQueue(in_worker);
+		std::vector<uint32_t> claimed(header->batchSize);
+		int numIdle = 0;
+
+		while ((header->shutdown.load(std::memory_order_acquire) == 0) &&
+		       (getppid() == header->parentPid) )
+		{
+			uint64_t tail = header->claimTail.load(std::memory_order_acquire);
+			const uint64_t head = header->submitHead.load(std::memory_order_acquire);
+
+			if (tail >= head)
+			{
+				Backoff(numIdle++);
+				continue;
+			}
+			numIdle = 0;
+
+			// read the entries before claiming them, the pool can not reuse
+			// them until claimTail has moved past
+			const uint64_t count = std::min<uint64_t>(head - tail, header->batchSize);
+			for (uint64_t i = 0; i < count; i++)
+			{
+				claimed[i] = segment.GetRing()[(tail + i) % header->numSlots];
+			}
+
+			if (!header->claimTail.compare_exchange_weak(tail, tail + count, std::memory_order_acq_rel))
+			{
+				continue;
+			}
+
+			for (uint64_t i = 0; i < count; i++)
+			{
+				auto* slot = segment.GetSlot(claimed[i]);
+				slot->worker = in_worker;
+				slot->state.store(RemoteEvaluatorSegment::Claimed, std::memory_order_release);
+			}
+
+			for (uint64_t i = 0; i < count; i++)
+			{
+				auto* slot = segment.GetSlot(claimed[i]);
+				slot->startTime.store(RemoteEvaluatorSegment::Now(), std::memory_order_relaxed);
+
+				slot->fitness = in_evaluateFn(slot->Genome(), header->genomeSize);
+				slot->state.store(RemoteEvaluatorSegment::Done, std::memory_order_release);
+
+				const uint64_t queueHead = queue->head.load(std::memory_order_relaxed);
+				queue->Entries()[queueHead % header->numSlots] = claimed[i];
+				queue->head.store(queueHead + 1, std::memory_order_release);
+			}
+		}
+
+		munmap(memory, info.st_size);
+		return 0;
+	}
+
+private:
+	static void Backoff(int in_numIdle)
+	{
+		if (in_numIdle < 64)
+		{
+			std::this_thread::yield();
+		}
+		else
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef SEARCHSTRATEGY_H
+#define SEARCHSTRATEGY_H
+
+#include "util.h"
+#include "userRNG.h"
+
+// Ask/tell interface for population based optimizers over flat weight
+// vectors. GeneticAlgoTrainer drives it: Ask() for a batch of candidates,
+// score them on the worker pool, Tell() the scores back.
+class SearchStrategy
+{
+public:
+	virtual ~SearchStrategy() = default;
+
+	virtual const char* Name() const = 0;
+
+	// one candidate per column, sized by the strategy
+	virtual void Ask(arma::mat& out_candidates) = 0;
+
+	// fitness of every column of the last Ask(), higher is better
+	virtual void Tell(const arma::mat& in_candidates, const arma::vec& in_fitness) = 0;
+
+protected:
+	// fills in_values from the calling thread's UserRNG engine, so
+	// deterministic runs stay reproducible
+	static void FillNormal(arma::mat& out_values)
+	{
+		auto normalFn = UserRNG::GetRngFn<double, std::normal_distribution<double>>(0.0, 1.0);
+		out_values.for_each([&normalFn] (double& it) { it = normalFn(); });
+	}
+
+	static void FillUniform(arma::mat& out_values, double in_min, double in_max)
+	{
+		auto uniformFn = UserRNG::GetRngFn(in_min, in_max);
+		out_values.for_each([&uniformFn] (double& it) { it = uniformFn(); });
+	}
+};
+
+#endif
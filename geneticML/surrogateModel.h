@@ -0,0 +1,136 @@
+#ifndef SURROGATEMODEL_H
+#define SURROGATEMODEL_H
+
+#include <cmath>
+#include <random>
+
+#include "util.h"
+#include "genome.h"
+
+// Cheap online estimate of the fitness of a genome, used to pick the most
+// promising of several candidate children before paying for a real
+// evaluation.
+//
+// Random Fourier features phi(x) = sqrt(2/D) cos(Wx + b) approximate an RBF
+// kernel of the given bandwidth, and a ridge regression on phi is refit on
+// the last maxSamples evaluated genomes.
+//
+// Features() and Predict() are const and safe to call from the workers while
+// nothing calls AddSample() or Fit().
+class SurrogateModel
+{
+public:
+	SurrogateModel(size_t in_dimension, int in_numFeatures, double in_bandwidth,
+	               int in_maxSamples, double in_ridge = 1e-3)
+	:dimension(in_dimension)
+	,numFeatures(in_numFeatures)
+	,maxSamples(in_maxSamples)
+	,ridge(in_ridge)
+	,projection(in_numFeatures, in_dimension)
+	,phase(in_numFeatures)
+	,sampleFeatures(in_numFeatures, in_maxSamples)
+	,sampleFitness(in_maxSamples)
+	,numSamples(0)
+	,nextSample(0)
+	,fitted(false)
+	,fitnessMean(0.0)
+	,fitnessScale(1.0)
+	{
+		// fixed seed, predictions must not depend on the run's rng
+		std::mt19937_64 featureRng(in_numFeatures * in_dimension);
+		std::normal_distribution<double> normal(0.0, 1.0 / in_bandwidth);
+		std::uniform_real_distribution<double> uniform(0.0, 2.0 * M_PI);
+
+		projection.for_each([&] (double& it) { it = normal(featureRng); });
+		phase.for_each([&] (double& it) { it = uniform(featureRng); });
+	}
+
+	bool IsReady() const { return fitted; }
+	int GetNumSamples() const { return numSamples; }
+
+	template<class Params>
+	arma::vec Features(const Params& in_params) const
+	{
+		const auto* weights = GenomeData(in_params);
+
+		arma::vec x(dimension);
+		for (size_t i = 0; i < dimension; i++)
+		{
+			x[i] = weights[i];
+		}
+
+		return std::sqrt(2.0 / numFeatures) * arma::cos(projection * x + phase);
+	}
+
+	double PredictFeatures(const arma::vec& in_features) const
+	{
+		return fitnessMean + fitnessScale * arma::dot(in_features, coefficients);
+	}
+
+	template<class Params>
+	double Predict(const Params& in_params) const
+	{
+		return PredictFeatures(Features(in_params));
+	}
+
+	// keeps the last maxSamples samples, the oldest one is overwritten
+	void AddSample(const arma::vec& in_features, double in_fitness)
+	{
+		if (!std::isfinite(in_fitness))
+		{
+			return;
+		}
+
+		sampleFeatures.col(nextSample) = in_features;
+		sampleFitness[nextSample] = in_fitness;
+
+		nextSample = (nextSample + 1) % maxSamples;
+		numSamples = std::min(numSamples + 1, maxSamples);
+	}
+
+	// solves (Phi Phi' + ridge I) w = Phi y on the normalized fitness
+	void Fit()
+	{
+		if (numSamples < 2)
+		{
+			return;
+		}
+
+		const arma::mat phi = sampleFeatures.cols(0, numSamples - 1);
+		arma::vec y = sampleFitness.subvec(0, numSamples - 1);
+
+		fitnessMean = arma::mean(y);
+		fitnessScale = std::max(arma::stddev(y), 1e-12);
+		y = (y - fitnessMean) / fitnessScale;
+
+		const arma::mat gram = phi * phi.t() + ridge * arma::eye<arma::mat>(numFeatures, numFeatures);
+		if (!arma::solve(coefficients, gram, phi * y))
+		{
+			Log("surrogate fit failed, keeping the previous model");
+			return;
+		}
+
+		fitted = true;
+	}
+
+private:
+	size_t dimension;
+	int numFeatures;
+	int maxSamples;
+	double ridge;
+
+	arma::mat projection;
+	arma::vec phase;
+
+	arma::mat sampleFeatures;
+	arma::vec sampleFitness;
+	int numSamples;
+	int nextSample;
+
+	bool fitted;
+	arma::vec coefficients;
+	double fitnessMean;
+	double fitnessScale;
+};
+
+#endif
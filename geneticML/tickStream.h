@@ -0,0 +1,233 @@
+#ifndef TICKSTREAM_H
+#define TICKSTREAM_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+// The most recent bars of a live series, in the GetInputData() layout.
+//
+// Holds the per tick open price deltas of the last Capacity() bars. Every
+// delta is written twice, capacity apart, so the last n deltas are always
+// contiguous and a window is a cube aliasing the buffer instead of a copy.
+// Appending is O(1) and never allocates.
+//
+// Windows and increments are only valid until the next Append().
+class TickRingBuffer
+{
+public:
+	explicit TickRingBuffer(arma::uword in_capacity)
+	:capacity(std::max<arma::uword>(in_capacity, 1))
+	,deltas(2 * capacity, 0.0)
+	,numAppended(0)
+	,lastTime(0)
+	,lastOpen(0.0)
+	{
+	}
+
+	// forbid copying of any kind, views point into the buffer
+	TickRingBuffer(const TickRingBuffer&) = delete;
+	TickRingBuffer& operator=(const TickRingBuffer&) = delete;
+
+	arma::uword Capacity() const { return capacity; }
+	arma::uword Size() const { return std::min<uint64_t>(numAppended, capacity); }
+
+	// bars accepted since construction, also the position to pass to
+	// GetIncrement() later
+	uint64_t GetNumAppended() const { return numAppended; }
+	time_t GetLastTime() const { return lastTime; }
+
+	// false for bars not newer than the last one, sources may repeat some
+	bool Append(const Bar& in_bar)
+	{
+		if ((numAppended > 0) && (in_bar.time <= lastTime))
+		{
+			return false;
+		}
+
+		// the first bar has no previous open, like in GetInputData()
+		const double delta = (numAppended > 0) ? lastOpen - in_bar.open : 0.0;
+
+		const arma::uword position = numAppended % capacity;
+		deltas[position] = delta;
+		deltas[position + capacity] = delta;
+
+		numAppended++;
+		lastTime = in_bar.time;
+		lastOpen = in_bar.open;
+		return true;
+	}
+
+	// the last in_count bars, all of them by default, (1, count, 1)
+	arma::cube GetWindow(arma::uword in_count = 0) const
+	{
+		const arma::uword count = (in_count == 0) ? Size() : std::min(in_count, Size());
+		return View(count);
+	}
+
+	// the bars appended after GetNumAppended() returned in_since, at most
+	// Capacity() of them
+	arma::cube GetIncrement(uint64_t in_since) const
+	{
+		const uint64_t count = (numAppended > in_since) ? numAppended - in_since : 0;
+		return View(std::min<uint64_t>(count, Size()));
+	}
+
+private:
+	arma::uword capacity;
+	std::vector<double> deltas;
+	uint64_t numAppended;
+	time_t lastTime;
+	double lastOpen;
+
+	arma::cube View(arma::uword in_count) const
+	{
+		// one past the newest copy of the last delta
+		const arma::uword end = (numAppended == 0) ? capacity
+			: (numAppended - 1) % capacity + capacity + 1;
+
+		double* viewMem = const_cast<double*>(deltas.data()) + end - in_count;
+		return arma::cube(viewMem, 1, in_count, 1, false, true);
+	}
+};
+
+// Feeds bars into a TickRingBuffer, polled from one thread.
+class TickSource
+{
+public:
+	virtual ~TickSource() = default;
+
+	// appends what arrived since the last call, returns the number of bars
+	// the buffer accepted
+	virtual size_t Poll(TickRingBuffer& io_buffer) = 0;
+
+	// nothing more will ever arrive
+	virtual bool IsFinished() const { return false; }
+};
+
+// Replays recorded bars a few at a time, for tests and backfills.
+class ReplayTickSource : public TickSource
+{
+public:
+	ReplayTickSource(std::vector<Bar> in_bars, size_t in_barsPerPoll)
+	:bars(std::move(in_bars))
+	,barsPerPoll(std::max<size_t>(in_barsPerPoll, 1))
+	,next(0)
+	{
+	}
+
+	size_t Poll(TickRingBuffer& io_buffer) override
+	{
+		size_t numAccepted = 0;
+		const size_t end = std::min(next + barsPerPoll, bars.size());
+
+		for (; next < end; next++)
+		{
+			numAccepted += io_buffer.Append(bars[next]);
+		}
+		return numAccepted;
+	}
+
+	bool IsFinished() const override { return next == bars.size(); }
+
+private:
+	std::vector<Bar> bars;
+	size_t barsPerPoll;
+	size_t next;
+};
+
+// Follows a text file another process appends bars to, one per line:
+//     2019-01-02 09:30:00,open,high,low,close,volume
+// Only complete lines are read. A file that shrinks was rotated or
+// truncated and is read again from the start.
+class FileTailTickSource : public TickSource
+{
+public:
+	explicit FileTailTickSource(const std::string& in_fileName)
+	:fileName(in_fileName)
+	,offset(0)
+	,numRejected(0)
+	{
+	}
+
+	// lines that did not parse, headers included
+	long long GetNumRejected() const { return numRejected; }
+
+	size_t Poll(TickRingBuffer& io_buffer) override
+	{
+		std::ifstream file(fileName, std::ios::binary);
+		if (!file.is_open())
+		{
+			return 0;
+		}
+
+		file.seekg(0, std::ios::end);
+		const std::streamoff size = file.tellg();
+		if (size < offset)
+		{
+			Log( "tick file shrank, reading from the start: ", fileName);
+			offset = 0;
+		}
+
+		file.seekg(offset);
+		std::string contents(size - offset, '\0');
+		file.read(&contents[0], contents.size());
+		contents.resize(file.gcount());
+
+		size_t numAccepted = 0;
+		size_t lineBegin = 0;
+
+		for (size_t lineEnd = contents.find('\n');
+		     lineEnd != std::string::npos;
+		     lineEnd = contents.find('\n', lineBegin) )
+		{
+			Bar bar;
+			if (ParseLine(contents.substr(lineBegin, lineEnd - lineBegin), bar))
+			{
+				numAccepted += io_buffer.Append(bar);
+			}
+			else
+			{
+				numRejected++;
+			}
+			lineBegin = lineEnd + 1;
+		}
+
+		// a partial last line is read again once it is complete
+		offset += lineBegin;
+		return numAccepted;
+	}
+
+private:
+	std::string fileName;
+	std::streamoff offset;
+	long long numRejected;
+
+	static bool ParseLine(const std::string& in_line, Bar& out_bar)
+	{
+		struct tm timeS = {};
+		timeS.tm_isdst = -1;
+
+		const char* rest = strptime(in_line.c_str(), "%Y-%m-%d %H:%M:%S", &timeS);
+		if (rest == nullptr)
+		{
+			return false;
+		}
+
+		long long volume;
+		if (sscanf(rest, ",%f,%f,%f,%f,%lld",
+		           &out_bar.open, &out_bar.high, &out_bar.low, &out_bar.close, &volume) != 5)
+		{
+			return false;
+		}
+
+		out_bar.time = mktime(&timeS);
+		out_bar.volume = (long) volume;
+		return true;
+	}
+};
+
+#endif
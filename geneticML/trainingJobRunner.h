@@ -0,0 +1,110 @@
+#ifndef TRAININGJOBRUNNER_H
+#define TRAININGJOBRUNNER_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "util.h"
+#include "ctpl_stl.h"
+
+// Runs many independent trainings, typically one per symbol, on one worker
+// pool shared by all of them.
+//
+// A job builds its GeneticAlgoTrainer on the pool it is given and runs it.
+// At most maxConcurrentJobs run at a time, each on its own control thread
+// that only waits on the pool. The trainers push one batch of tasks per
+// epoch and the pool's queue is FIFO, so concurrent jobs take turns epoch
+// by epoch and a job whose epoch is finishing hands idle workers to the
+// next one.
+class TrainingJobRunner
+{
+using ThreadPool = ctpl::thread_pool;
+
+public:
+	using Job = std::function<void(ThreadPool& in_workers)>;
+
+	struct Settings
+	{
+		int numWorkers = std::thread::hardware_concurrency();
+
+		// 0 means one per four workers, at least two
+		int maxConcurrentJobs = 0;
+	};
+
+	explicit TrainingJobRunner(const Settings& in_settings)
+	:settings(in_settings)
+	,workers(std::max(in_settings.numWorkers, 1))
+	{
+		if (settings.maxConcurrentJobs <= 0)
+		{
+			settings.maxConcurrentJobs = std::max(settings.numWorkers / 4, 2);
+		}
+	}
+
+	// forbid copying of any kind
+	TrainingJobRunner(const TrainingJobRunner&) = delete;
+	TrainingJobRunner& operator=(const TrainingJobRunner&) = delete;
+
+	ThreadPool& GetWorkers() { return workers; }
+
+	// jobs start in the order they were added
+	void Add(const std::string& in_name, Job in_job)
+	{
+		jobs.push_back({in_name, std::move(in_job)});
+	}
+
+	// runs every added job and waits for all of them
+	void RunAll()
+	{
+		std::atomic<size_t> nextJob(0);
+		std::vector<std::thread> controlThreads;
+
+		const int numControlThreads = std::min<int>(settings.maxConcurrentJobs, jobs.size());
+
+		for (int i = 0; i < numControlThreads; i++)
+		{
+			controlThreads.emplace_back([this, &nextJob] ()
+			{
+				for (size_t j = nextJob++; j < jobs.size(); j = nextJob++)
+				{
+					RunJob(jobs.at(j));
+				}
+			});
+		}
+
+		for (auto& it : controlThreads)
+		{
+			it.join();
+		}
+
+		jobs.clear();
+	}
+
+private:
+	struct NamedJob
+	{
+		std::string name;
+		Job job;
+	};
+
+	void RunJob(NamedJob& io_job)
+	{
+		Log( "job started: ", io_job.name);
+
+		const auto start = std::chrono::steady_clock::now();
+		io_job.job(workers);
+
+		Log( "job completed: ", io_job.name, " seconds ",
+			 std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() );
+	}
+
+	Settings settings;
+	std::vector<NamedJob> jobs;
+	ThreadPool workers;
+};
+
+#endif
@@ -1,20 +1,54 @@
 #ifndef USERRNG_H 
 #define USERRNG_H 
 
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <random>
+#include <thread>
 
 namespace UserRNG {
 
-// static random engine to use with all distributions
-static std::default_random_engine rng(
-        (int) std::chrono::system_clock::now().time_since_epoch().count());
+using Engine = std::default_random_engine;
+
+// every thread draws from its own engine, seeded from the wall clock and the
+// thread id until Seed() is called on that thread
+inline Engine& GetEngine()
+{
+	thread_local Engine rng(
+		(unsigned) (std::chrono::system_clock::now().time_since_epoch().count() ^
+			std::hash<std::thread::id>()(std::this_thread::get_id())) );
+	return rng;
+}
+
+// splitmix64 step, spreads nearby seeds over the whole seed space
+inline uint64_t MixSeed(uint64_t in_seed, uint64_t in_value)
+{
+	uint64_t z = in_seed + 0x9e3779b97f4a7c15ull * (in_value + 1);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+// reseeds the calling thread's engine
+inline void Seed(uint64_t in_seed)
+{
+	GetEngine().seed((Engine::result_type) MixSeed(in_seed, 0));
+}
+
+// reseeds the calling thread's engine for one unit of work, so its draws
+// depend only on the run seed and (epoch, slot), not on which thread runs it
+inline void Seed(uint64_t in_seed, uint64_t in_epoch, uint64_t in_slot)
+{
+	GetEngine().seed((Engine::result_type) MixSeed(MixSeed(in_seed, in_epoch), in_slot));
+}
 
 // 'most' generic fn that all the other functions will call with their own types
 // returns a functor that generates a random number with the given distribution
 template <typename T, typename Distribution, typename ...Args>
 auto GetRngFn(Args&&... args)
 {
-	return [dist = Distribution(args...)]() mutable { return dist(rng); };
+	return [dist = Distribution(args...)]() mutable { return dist(GetEngine()); };
 }
 
 // gets random real numbers (doubles) between the passed in range
@@ -3,6 +3,8 @@
 _LogContents::LogString _LogContents::logContents(
     new std::stringstream(), WriteToFileThenDelete() );
 
+std::mutex _LogContents::logMutex;
+
 void ReportFatalError(const std::string& error)
 {
     Log(error);
@@ -21,13 +23,12 @@ arma::cube GetInputDataExitOnError(const std::string& fileName)
 	return std::get<arma::cube>(dataVar);
 }
 
-CubeWError GetInputData(const std::string& in_fileName)
+BarsWError GetInputBars(const std::string& in_fileName)
 {
 using Json = nlohmann::json;
 using StrJsonMap = std::unordered_map<std::string, Json>;
 
-using TickData = std::tuple<float, float, float, float, long>;
-using TimeTickMap = std::map<time_t, TickData>;
+using TimeTickMap = std::map<time_t, Bar>;
 
 	TimeTickMap impData;
 	Json jsonBase;
@@ -59,12 +60,14 @@ using TimeTickMap = std::map<time_t, TickData>;
 
 				strptime(timeStr.c_str(), "%Y-%m-%d %H:%M:%S", &timeS);
 
-				impData.emplace( mktime(&timeS), TickData(
+				const time_t time = mktime(&timeS);
+				impData.emplace( time, Bar{
+						time,
 						std::stof(tickData.at("1. open").get<std::string>()),
 						std::stof(tickData.at("2. high").get<std::string>()),
 						std::stof(tickData.at("3. low").get<std::string>()),
 						std::stof(tickData.at("4. close").get<std::string>()),
-						std::stol(tickData.at("5. volume").get<std::string>()) ));
+						std::stol(tickData.at("5. volume").get<std::string>()) });
 			}
 		}
 	}
@@ -82,15 +85,34 @@ using TimeTickMap = std::map<time_t, TickData>;
 		return "error: could not parse data from file: "s + in_fileName;
 	}
 
-	arma::cube inputData = arma::zeros<arma::cube>(1, impData.size(), 1);
+	std::vector<Bar> bars;
+	bars.reserve(impData.size());
+	for(auto& it : impData)
+	{
+		bars.push_back(it.second);
+	}
+
+	return bars;
+}
+
+CubeWError GetInputData(const std::string& in_fileName)
+{
+	BarsWError barsVar = GetInputBars(in_fileName);
+
+	if (auto* error = std::get_if<ErrMsg>(&barsVar); error != nullptr)
+	{
+		return *error;
+	}
+
+	const std::vector<Bar>& bars = std::get<std::vector<Bar>>(barsVar);
+	arma::cube inputData = arma::zeros<arma::cube>(1, bars.size(), 1);
 
 	int count = 0;
-	double lastVal = std::get<0>((*impData.begin()).second);
-	for(auto& it : impData)
+	double lastVal = bars.front().open;
+	for(auto& it : bars)
 	{
-		Log(it.first);
-		inputData(0,count++,0) = (lastVal - std::get<0>(it.second) );
-		lastVal = std::get<0>(it.second);
+		inputData(0,count++,0) = (lastVal - it.open );
+		lastVal = it.open;
 	}
 
 	return inputData;
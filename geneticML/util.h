@@ -1,10 +1,14 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <atomic>
+#include <ctime>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <variant>
+#include <vector>
 
 #include <mlpack/prereqs.hpp>
 #include <nlohmann/json.hpp>
@@ -14,9 +18,19 @@ using namespace std::string_literals;
 // used for writing an object (ie stringstream) to a file before being deleted
 struct WriteToFileThenDelete
 {
+	// cleared in processes that must not overwrite the log file, like
+	// remote evaluators
+	static inline std::atomic<bool> enabled{true};
+
 	template <class T>
 	void operator()(T* p)
 	{
+		if(!enabled)
+		{
+			delete p;
+			return;
+		}
+
 		if(std::ofstream file("/tmp/log.txt"); file.is_open())
 		{
 			file << p->str().c_str();
@@ -28,6 +42,9 @@ struct WriteToFileThenDelete
 struct _LogContents {
 using LogString = std::unique_ptr<std::stringstream, WriteToFileThenDelete>;
     static LogString logContents;
+
+    // several trainers can log at once, see TrainingJobRunner
+    static std::mutex logMutex;
 };
 
 template <typename... Args>
@@ -40,6 +57,7 @@ void LogToStream(std::ostream& stream, Args&&... args)
 template <typename... Args>
 void Log(Args&&... args)
 {
+    std::lock_guard<std::mutex> lock(_LogContents::logMutex);
     LogToStream(*_LogContents::logContents, args...);
 	LogToStream(std::cout, args...);
 }
@@ -49,6 +67,23 @@ void ReportFatalError(const std::string& error);
 using ErrMsg = std::string;
 using CubeWError = std::variant<arma::cube, ErrMsg>;
 
+// one OHLCV bar of a market data file
+struct Bar
+{
+	time_t time;
+	float open;
+	float high;
+	float low;
+	float close;
+	long volume;
+};
+
+using BarsWError = std::variant<std::vector<Bar>, ErrMsg>;
+
+// bars in time order, one per timestamp
+BarsWError GetInputBars(const std::string& in_fileName);
+
+// per tick open price deltas, (1, ticks, 1)
 CubeWError GetInputData(const std::string& in_fileName);
 arma::cube GetInputDataExitOnError(const std::string& fileName);
 
@@ -0,0 +1,241 @@
+#ifndef VALIDATIONENGINE_H
+#define VALIDATIONENGINE_H
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include "util.h"
+#include "ctpl_stl.h"
+
+// Splits one loaded series into evaluation windows along the time (column)
+// axis and scores candidates on every window.
+//
+// The windows are cubes that alias the memory of the loaded series, so no
+// data is copied per fold. The series must outlive the engine.
+class ValidationEngine
+{
+using ThreadPool = ctpl::thread_pool;
+
+public:
+	enum class FoldType {WalkForward=0, KFold};
+	enum class AggregateType {Mean=0, WorstCase};
+
+	struct Settings
+	{
+		FoldType foldType = FoldType::WalkForward;
+		AggregateType aggregateType = AggregateType::Mean;
+		int numFolds = 4;
+
+		// walk-forward only, 0 means derive them from numFolds
+		int windowSize = 0;
+		int stepSize = 0;
+
+		// walk-forward only, every window starts at the first tick
+		bool anchored = false;
+	};
+
+	struct Fold
+	{
+		arma::uword begin;
+		arma::uword count;
+	};
+
+	struct Scores
+	{
+		std::vector<double> foldScores;
+		double mean = 0.0;
+		double worst = 0.0;
+		double aggregate = 0.0;
+	};
+
+	Settings& GetSettings() { return settings; }
+	const Settings& GetSettings() const { return settings; }
+	const std::vector<Fold>& GetFolds() const { return folds; }
+	const std::vector<arma::cube>& GetFoldViews() const { return foldViews; }
+
+	// forbid copying of any kind, the views point into in_data
+	ValidationEngine() = delete;
+	ValidationEngine(const ValidationEngine& rhs) = delete;
+	ValidationEngine(const ValidationEngine&& rhs) = delete;
+
+	// without a pool EvaluateParallel() scores the candidates one after the
+	// other on the calling thread
+	explicit ValidationEngine(const arma::cube& in_data)
+	:data(in_data)
+	,settings()
+	,workers(nullptr)
+	{
+		BuildFolds();
+	}
+
+	// EvaluateParallel() runs on in_workers, which has to outlive the engine
+	ValidationEngine(const arma::cube& in_data, ThreadPool& in_workers)
+	:data(in_data)
+	,settings()
+	,workers(&in_workers)
+	{
+		BuildFolds();
+	}
+
+	// recompute the windows after changing the settings
+	void BuildFolds()
+	{
+		const long long numTicks = data.n_cols;
+		const long long numFolds = std::max(settings.numFolds, 1);
+
+		folds.clear();
+		foldViews.clear();
+
+		if (settings.foldType == FoldType::KFold)
+		{
+			const long long foldSize = numTicks / numFolds;
+
+			for (long long i = 0; i < numFolds; i++)
+			{
+				// the last fold takes the remainder
+				long long count = (i == numFolds - 1) ? numTicks - i * foldSize : foldSize;
+				AddFold(i * foldSize, count);
+			}
+		}
+		else
+		{
+			const long long windowSize = (settings.windowSize > 0)
+				? settings.windowSize : numTicks / numFolds;
+			const long long stepSize = (settings.stepSize > 0)
+				? settings.stepSize : windowSize;
+
+			for (long long end = windowSize; end <= numTicks; end += stepSize)
+			{
+				long long begin = settings.anchored ? 0 : end - windowSize;
+				AddFold(begin, end - begin);
+			}
+		}
+
+		if (folds.empty())
+		{
+			ReportFatalError("error, not enough data for the validation folds");
+		}
+
+		// reserve first, growing the vector would deep copy the aliases
+		foldViews.reserve(folds.size());
+
+		for (auto& it : folds)
+		{
+			AddFoldView(it);
+		}
+	}
+
+	// scores one candidate on every fold, one after the other
+	// in_foldFitnessFn(candidate, const arma::cube& foldData) -> double
+	template<class FoldFitnessFn, class BaseType>
+	Scores Evaluate(const FoldFitnessFn& in_foldFitnessFn, BaseType& in_candidate) const
+	{
+		Scores scores;
+		scores.foldScores.reserve(foldViews.size());
+
+		for (auto& it : foldViews)
+		{
+			scores.foldScores.push_back(in_foldFitnessFn(in_candidate, it));
+		}
+
+		Aggregate(scores);
+		return scores;
+	}
+
+	// scores many candidates on the worker pool. Models like the mlpack RNN
+	// keep state while predicting, so the folds of one candidate stay on one
+	// worker and only different candidates run concurrently.
+	template<class FoldFitnessFn, class BaseType>
+	std::vector<Scores> EvaluateParallel(
+                const FoldFitnessFn& in_foldFitnessFn,
+                const std::vector<BaseType*>& in_candidates )
+	{
+		std::vector<Scores> results(in_candidates.size());
+
+		if (workers == nullptr)
+		{
+			for (size_t i = 0; i < in_candidates.size(); i++)
+			{
+				results[i] = Evaluate(in_foldFitnessFn, *in_candidates[i]);
+			}
+			return results;
+		}
+
+		std::vector<std::future<void>> futures;
+		futures.reserve(in_candidates.size());
+
+		for (size_t i = 0; i < in_candidates.size(); i++)
+		{
+			futures.emplace_back(workers->push(
+				[this, &in_foldFitnessFn, &in_candidates, &results, i] (int)
+				{
+					results[i] = Evaluate(in_foldFitnessFn, *in_candidates[i]);
+				} ));
+		}
+
+		for (auto& it : futures)
+		{
+			it.get();
+		}
+
+		return results;
+	}
+
+	// wraps a fold fitness into the single argument FitnessFn the trainer
+	// expects, returning the aggregated score across the folds. The fold
+	// fitness is copied, the engine has to outlive the result.
+	template<class FoldFitnessFn>
+	auto MakeFitnessFn(const FoldFitnessFn& in_foldFitnessFn) const
+	{
+		return [this, foldFitnessFn = in_foldFitnessFn] (auto& in_candidate)
+		{
+			return Evaluate(foldFitnessFn, in_candidate).aggregate;
+		};
+	}
+
+private:
+	const arma::cube& data;
+	Settings settings;
+	ThreadPool* workers;
+
+	std::vector<Fold> folds;
+	std::vector<arma::cube> foldViews;
+
+	void AddFold(long long in_begin, long long in_count)
+	{
+		if (in_count > 0)
+		{
+			folds.push_back(Fold{(arma::uword) in_begin, (arma::uword) in_count});
+		}
+	}
+
+	void AddFoldView(const Fold& in_fold)
+	{
+		if (data.n_slices == 1)
+		{
+			// columns of a single slice are contiguous, alias them directly
+			double* foldMem = const_cast<double*>(data.slice_colptr(0, in_fold.begin));
+			foldViews.emplace_back(foldMem, data.n_rows, in_fold.count, 1, false, true);
+		}
+		else
+		{
+			// sequences spread over slices are not contiguous per window
+			foldViews.emplace_back(data.cols(in_fold.begin, in_fold.begin + in_fold.count - 1));
+		}
+	}
+
+	void Aggregate(Scores& io_scores) const
+	{
+		const auto& foldScores = io_scores.foldScores;
+
+		io_scores.mean = std::accumulate(foldScores.begin(), foldScores.end(), 0.0)
+				/ foldScores.size();
+		io_scores.worst = *std::min_element(foldScores.begin(), foldScores.end());
+
+		io_scores.aggregate = (settings.aggregateType == AggregateType::WorstCase)
+				? io_scores.worst : io_scores.mean;
+	}
+};
+
+#endif
@@ -0,0 +1,76 @@
+// CMA-ES has to learn the shape of a badly scaled problem instead of
+// sampling isotropically like plain CSA, and still converge on it.
+//
+// The ellipsoid sum((s_i x_i)^2) with s_i from 1 to 100 has a Hessian
+// condition number of 10^4. Once adapted, the sampling axes are about as
+// long as 1/s_i, so their length ratio approaches sqrt(10^4) = 100.
+//
+// make -C tests check
+
+#include "cmaEsStrategy.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+
+int main()
+{
+	const size_t dimension = 10;
+	const size_t lambda = 10;
+	const int maxGenerations = 1000;
+	const double targetCost = 1e-10;
+
+	UserRNG::Seed(1);
+	CmaEsStrategy strategy(dimension, lambda, -1.0, 1.0, 0.3);
+
+	// axis i is 10^(2i/(n-1)) times steeper than axis 0
+	const arma::vec scales = arma::exp10(arma::linspace<arma::vec>(0.0, 2.0, dimension));
+	const double expectedRatio = scales.max() / scales.min();
+
+	auto cost = [&scales] (const arma::vec& in_x)
+	{
+		return arma::accu(arma::square(scales % in_x));
+	};
+
+	arma::mat candidates;
+	arma::vec fitness;
+	double bestCost = std::numeric_limits<double>::max();
+	int generation = 0;
+
+	for (; (generation < maxGenerations) && (bestCost > targetCost); generation++)
+	{
+		strategy.Ask(candidates);
+
+		fitness.set_size(candidates.n_cols);
+		for (arma::uword k = 0; k < candidates.n_cols; k++)
+		{
+			fitness[k] = -cost(candidates.col(k));
+			bestCost = std::min(bestCost, -fitness[k]);
+		}
+
+		strategy.Tell(candidates, fitness);
+	}
+
+	const arma::vec& lengths = strategy.GetAxisLengths();
+	const double ratio = lengths.max() / lengths.min();
+
+	printf("generations %d, best cost %g, axis length ratio %f (expected about %f)\n",
+	       generation, bestCost, ratio, expectedRatio);
+
+	if (bestCost > targetCost)
+	{
+		printf("FAILED: did not converge to the optimum\n");
+		return EXIT_FAILURE;
+	}
+
+	// isotropic sampling stays near 1, a learned shape lands within a small
+	// factor of the conditioning
+	if ((ratio < expectedRatio / 2.5) || (ratio > expectedRatio * 2.5))
+	{
+		printf("FAILED: the covariance did not adapt to the problem's scaling\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+// A fitness function that takes a FitnessContext allocates its scratch from
+// the worker's EpochArena. The arenas are reset at every epoch boundary, so
+// however long a run is, the reserved blocks serve every allocation and
+// nothing reaches the heap.
+//
+// make -C tests check
+
+#include "geneticAlgoTrainer.h"
+
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <memory_resource>
+#include <numeric>
+#include <vector>
+
+class Point
+{
+using DataType = std::array<double, 32>;
+public:
+	DataType& Parameters() { return coordinates; }
+	Point()
+	:coordinates()
+	{
+	}
+
+private:
+	DataType coordinates;
+};
+
+int main()
+{
+	// the parent writes no log file for a test
+	WriteToFileThenDelete::enabled = false;
+
+	auto createPoint = [] ()
+	{
+		return new Point();
+	};
+
+	// grows a scratch vector one element at a time, like a fold's
+	// predictions would, so every call allocates and frees a few blocks
+	auto calculateFitness = [] (Point& in_point, const FitnessContext& in_context)
+	{
+		std::pmr::vector<double> squares(in_context.memory);
+		for (double it : in_point.Parameters())
+		{
+			squares.push_back(it * it);
+		}
+		return -std::accumulate(squares.begin(), squares.end(), 0.0);
+	};
+
+	GeneticAlgoTrainer trainer(createPoint, calculateFitness);
+	auto& settings = trainer.GetSettings();
+	settings.minWeight = -1.0;
+	settings.maxWeight = 1.0;
+	settings.numPopulation = 200;
+
+	std::vector<EpochArena::Stats> stats;
+
+	for (int numEpoch : {3, 12})
+	{
+		settings.numEpoch = numEpoch;
+		trainer.Run();
+		stats.push_back(trainer.GetArenaStats());
+
+		// Log() starts its lines with the line break
+		printf("\n%d epochs: %lld arena allocations, %lld from the heap\n",
+		       numEpoch, stats.back().numAllocations, stats.back().numHeapAllocations);
+	}
+
+	if ((stats[0].numAllocations == 0) || (stats[1].numAllocations <= stats[0].numAllocations))
+	{
+		printf("FAILED: the fitness scratch did not go through the arenas\n");
+		return EXIT_FAILURE;
+	}
+
+	if ((stats[0].numHeapAllocations != 0) || (stats[1].numHeapAllocations != 0))
+	{
+		printf("FAILED: the arenas fell back to the heap\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,124 @@
+// GenomeIndex finds near duplicates through LSH bands instead of comparing
+// every pair of signatures. NicheCount() has to match that pairwise count
+// for every near duplicate distance. Genomes that share an exact hash but not
+// their weights must not count as copies.
+//
+// The signatures are made up instead of computed, so that near and exact
+// matches are common enough to test.
+//
+// make -C tests check
+
+#include "genomeIndex.h"
+
+#include <array>
+#include <bitset>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+using Genome = std::array<double, 4>;
+
+static bool failed = false;
+
+static void Expect(bool in_condition, const char* in_what, int in_distance)
+{
+	if (!in_condition)
+	{
+		printf("FAILED: %s, near distance %d\n", in_what, in_distance);
+		failed = true;
+	}
+}
+
+int main()
+{
+	const int numGenomes = 400;
+	const int groupSize = 20;
+
+	std::mt19937_64 rng(3);
+
+	for (int distance : {0, 1, 3, 5, 10, 20, 40, 63, 100})
+	{
+		const int clamped = std::min(distance, 63);
+		GenomeIndex index(Genome().size(), 0.0, distance);
+
+		std::vector<GenomeSignature> signatures(numGenomes);
+		std::vector<Genome> genomes(numGenomes);
+
+		// each group starts from one signature and genome, its members flip
+		// a few bits around the near distance. Half of them copy the weights
+		// of the group's first genome, half collide on its hash only.
+		for (int i = 0; i < numGenomes; i++)
+		{
+			const int first = i - i % groupSize;
+
+			if (i == first)
+			{
+				signatures[i] = GenomeSignature{rng(), rng()};
+				genomes[i] = Genome{(double) i, 0.0, 0.0, 0.0};
+			}
+			else
+			{
+				uint64_t flips = 0;
+				for (int k = rng() % (clamped + 3); k > 0; k--)
+				{
+					flips |= 1ull << (rng() % 64);
+				}
+
+				signatures[i].simHash = signatures[first].simHash ^ flips;
+				signatures[i].exact = (rng() % 3 == 0) ? rng() : signatures[first].exact;
+				genomes[i] = (i % 2 == 0) ? genomes[first] : Genome{(double) i, 1.0, 0.0, 0.0};
+			}
+
+			index.Insert(&genomes[i], signatures[i], genomes[i]);
+		}
+
+		for (int i = 0; i < numGenomes; i++)
+		{
+			int bruteForce = 0;
+
+			for (int j = 0; j < numGenomes; j++)
+			{
+				if (clamped == 0)
+				{
+					bruteForce += (signatures[j].exact == signatures[i].exact) && (genomes[j] == genomes[i]);
+				}
+				else
+				{
+					bruteForce += (int) std::bitset<64>(signatures[i].simHash ^ signatures[j].simHash).count() <= clamped;
+				}
+			}
+
+			Expect(index.NicheCount(&genomes[i]) == std::min(bruteForce, 256), "niche count differs from the pairwise count", distance);
+		}
+
+		// a new genome colliding with an indexed hash is only a duplicate
+		// when the weights match too
+		const Genome copy = genomes[0];
+		const Genome collision = Genome{-1.0, -1.0, -1.0, -1.0};
+		const GenomeSignature far = GenomeSignature{signatures[0].exact, ~signatures[0].simHash};
+
+		bool farIsNear = false;
+		for (int j = 0; (j < numGenomes) && (clamped > 0); j++)
+		{
+			farIsNear |= (int) std::bitset<64>(far.simHash ^ signatures[j].simHash).count() <= clamped;
+		}
+
+		Expect(index.IsDuplicate(far, copy), "exact copy not rejected", distance);
+		Expect(index.IsDuplicate(far, collision) == farIsNear, "hash collision rejected as a copy", distance);
+
+		// removing every other genome leaves the index consistent
+		for (int i = 0; i < numGenomes; i += 2)
+		{
+			index.Remove(&genomes[i]);
+		}
+		Expect(index.NicheCount(&genomes[0]) == 1, "removed genome still indexed", distance);
+	}
+
+	if (failed)
+	{
+		return EXIT_FAILURE;
+	}
+
+	printf("passed\n");
+	return EXIT_SUCCESS;
+}
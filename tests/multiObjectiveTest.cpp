@@ -0,0 +1,142 @@
+// NonDominatedSort() has to rank like peeling fronts off a pairwise
+// dominance check, ties and identical solutions included. With three or more
+// objectives it must stay well below that O(M N^2) cost, even when all of the
+// population is one front, which is the usual case late in a run.
+//
+// make -C tests check
+
+#include "multiObjective.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+static bool failed = false;
+
+// fronts by repeatedly removing the non-dominated solutions
+template <size_t M>
+std::vector<int> BruteForceSort(const std::vector<Objectives<M>>& in_objectives)
+{
+	const size_t num = in_objectives.size();
+	std::vector<int> ranks(num, -1);
+
+	for (int front = 0, numRanked = 0; numRanked < (int) num; front++)
+	{
+		std::vector<size_t> current;
+
+		for (size_t i = 0; i < num; i++)
+		{
+			bool dominated = false;
+			for (size_t j = 0; (j < num) && !dominated && (ranks[i] < 0); j++)
+			{
+				dominated = (ranks[j] < 0) && Dominates(in_objectives[j], in_objectives[i]);
+			}
+
+			if ((ranks[i] < 0) && !dominated)
+			{
+				current.push_back(i);
+			}
+		}
+
+		for (size_t it : current)
+		{
+			ranks[it] = front;
+		}
+		numRanked += (int) current.size();
+	}
+
+	return ranks;
+}
+
+// in_numValues > 0 draws from that many levels per objective, to get ties
+template <size_t M>
+void CheckRandom(std::mt19937_64& io_rng, size_t in_num, int in_numValues)
+{
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	std::vector<Objectives<M>> objectives(in_num);
+
+	for (auto& it : objectives)
+	{
+		for (auto& value : it)
+		{
+			value = (in_numValues > 0)
+				? (double) (io_rng() % in_numValues)
+				: uniform(io_rng);
+		}
+	}
+
+	if (NonDominatedSort(objectives) != BruteForceSort(objectives))
+	{
+		printf("FAILED: %zu objectives, %zu solutions, %d levels differ from the brute force ranks\n",
+		       M, in_num, in_numValues);
+		failed = true;
+	}
+}
+
+int main()
+{
+	std::mt19937_64 rng(7);
+
+	for (size_t num : {0, 1, 2, 3, 10, 50, 200, 1000})
+	{
+		for (int numValues : {0, 2, 5, 20})
+		{
+			CheckRandom<3>(rng, num, numValues);
+			CheckRandom<4>(rng, num, numValues);
+		}
+	}
+
+	// one front: every solution lies on the plane x + y + z = 1
+	const size_t numFront = 10000;
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	std::vector<Objectives<3>> front(numFront);
+
+	for (auto& it : front)
+	{
+		const double x = uniform(rng);
+		const double y = uniform(rng) * (1.0 - x);
+		it = {x, y, 1.0 - x - y};
+	}
+
+	using Clock = std::chrono::steady_clock;
+
+	const auto sortStart = Clock::now();
+	const std::vector<int> ranks = NonDominatedSort(front);
+	const double sortSeconds = std::chrono::duration<double>(Clock::now() - sortStart).count();
+
+	// the cost of comparing every pair, as a yardstick for this machine
+	const auto pairsStart = Clock::now();
+	size_t numDominated = 0;
+	for (auto& a : front)
+	{
+		for (auto& b : front)
+		{
+			numDominated += Dominates(a, b);
+		}
+	}
+	const double pairsSeconds = std::chrono::duration<double>(Clock::now() - pairsStart).count();
+
+	printf("%zu solutions on one front: sorted in %f seconds, pairwise check %f seconds\n",
+	       numFront, sortSeconds, pairsSeconds);
+
+	if ((*std::max_element(ranks.begin(), ranks.end()) != 0) || (numDominated != 0))
+	{
+		printf("FAILED: a single front was split\n");
+		failed = true;
+	}
+
+	if (sortSeconds > pairsSeconds / 10.0)
+	{
+		printf("FAILED: sorting one front is not much faster than comparing every pair\n");
+		failed = true;
+	}
+
+	if (failed)
+	{
+		return EXIT_FAILURE;
+	}
+
+	printf("passed\n");
+	return EXIT_SUCCESS;
+}